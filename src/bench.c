@@ -0,0 +1,336 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2014 Robin Müller.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * Microbenchmark for the gesture detection. Synthetic multi-touch gestures are
+ * fed through gesture recognizers and the emitted events are counted instead of
+ * written to uinput. With several threads every thread feeds its own recognizer.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <getopt.h>
+#include <pthread.h>
+
+#include <linux/input.h>
+
+#include "common.h"
+#include "gesture_recognizer.h"
+
+#define TOUCH_WIDTH 3000
+#define TOUCH_HEIGHT 2000
+#define FINGER_SPACING 250
+#define MAX_THREADS 64
+
+typedef enum scenario_type { SWIPE_SCENARIO, SCROLL_SCENARIO, PINCH_SCENARIO } scenario_type_t;
+
+typedef struct scenario {
+  const char *name;
+  scenario_type_t type;
+  unsigned int fingers;
+} scenario_t;
+
+static const scenario_t scenarios[] = {
+  { "swipe", SWIPE_SCENARIO, 1 },
+  { "swipe", SWIPE_SCENARIO, 2 },
+  { "swipe", SWIPE_SCENARIO, 3 },
+  { "swipe", SWIPE_SCENARIO, 4 },
+  { "swipe", SWIPE_SCENARIO, 5 },
+  { "scroll", SCROLL_SCENARIO, 2 },
+  { "pinch", PINCH_SCENARIO, 2 }
+};
+
+static const unsigned int tool_codes[] = {
+  BTN_TOOL_FINGER, BTN_TOOL_DOUBLETAP, BTN_TOOL_TRIPLETAP, BTN_TOOL_QUADTAP, BTN_TOOL_QUINTTAP
+};
+
+// counted per thread, so the threads don't disturb each other
+static _Thread_local unsigned long allocations;
+
+// the bench is linked with --wrap for the allocation functions to count them
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+  allocations++;
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size) {
+  allocations++;
+  return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+  allocations++;
+  return __real_realloc(ptr, size);
+}
+
+static void count_events(input_event_array_t *input_events, void *data) {
+  *(unsigned long*) data += input_events->length;
+}
+
+typedef struct event_stream {
+  struct input_event *events;
+  size_t length;
+  size_t capacity;
+  int64_t time;
+  unsigned int frames;
+} event_stream_t;
+
+static void add_event(event_stream_t *stream, int type, int code, int value) {
+  if (stream->length == stream->capacity) {
+    stream->capacity = stream->capacity ? stream->capacity * 2 : 1024;
+    stream->events = __real_realloc(stream->events, stream->capacity * sizeof(struct input_event));
+    if (!stream->events) {
+      perror("error: realloc");
+      exit(EXIT_FAILURE);
+    }
+  }
+  struct input_event *event = &stream->events[stream->length];
+  event->time.tv_sec = stream->time / 1000000;
+  event->time.tv_usec = stream->time % 1000000;
+  event->type = type;
+  event->code = code;
+  event->value = value;
+  stream->length++;
+}
+
+static void add_frame_end(event_stream_t *stream, unsigned int rate) {
+  add_event(stream, EV_SYN, SYN_REPORT, 0);
+  stream->time += 1000000 / rate;
+  stream->frames++;
+}
+
+/*
+ * Appends one gesture of the given scenario: touch down, frames of movement, lift.
+ */
+static void add_gesture(event_stream_t *stream, const scenario_t *scenario, unsigned int frames, unsigned int rate) {
+  unsigned int i, frame;
+  int x[MAX_FINGERS], y[MAX_FINGERS];
+  for (i = 0; i < scenario->fingers; i++) {
+    x[i] = TOUCH_WIDTH / 2 - FINGER_SPACING * 2 + FINGER_SPACING * i;
+    y[i] = TOUCH_HEIGHT / 2;
+    add_event(stream, EV_ABS, ABS_MT_SLOT, i);
+    add_event(stream, EV_ABS, ABS_MT_TRACKING_ID, i + 1);
+    add_event(stream, EV_ABS, ABS_MT_POSITION_X, x[i]);
+    add_event(stream, EV_ABS, ABS_MT_POSITION_Y, y[i]);
+  }
+  add_event(stream, EV_KEY, BTN_TOUCH, 1);
+  add_event(stream, EV_KEY, tool_codes[scenario->fingers - 1], 1);
+  add_frame_end(stream, rate);
+
+  for (frame = 0; frame < frames; frame++) {
+    for (i = 0; i < scenario->fingers; i++) {
+      switch (scenario->type) {
+        case SWIPE_SCENARIO:
+          x[i] += TOUCH_WIDTH / 2 / frames;
+          break;
+        case SCROLL_SCENARIO:
+          y[i] += TOUCH_HEIGHT / 2 / frames;
+          break;
+        case PINCH_SCENARIO:
+          x[i] += (i == 0 ? -1 : 1) * (TOUCH_WIDTH / 4 / frames);
+          break;
+      }
+      add_event(stream, EV_ABS, ABS_MT_SLOT, i);
+      add_event(stream, EV_ABS, ABS_MT_POSITION_X, x[i]);
+      add_event(stream, EV_ABS, ABS_MT_POSITION_Y, y[i]);
+    }
+    add_frame_end(stream, rate);
+  }
+
+  for (i = 0; i < scenario->fingers; i++) {
+    add_event(stream, EV_ABS, ABS_MT_SLOT, i);
+    add_event(stream, EV_ABS, ABS_MT_TRACKING_ID, -1);
+  }
+  add_event(stream, EV_KEY, BTN_TOUCH, 0);
+  add_event(stream, EV_KEY, tool_codes[scenario->fingers - 1], 0);
+  add_frame_end(stream, rate);
+  // pause between the gestures
+  stream->time += 500000;
+}
+
+static void init_config(configuration_t *config) {
+  unsigned int i, j, k;
+  static const int direction_keys[DIRECTIONS_COUNT] = { KEY_UP, KEY_DOWN, KEY_LEFT, KEY_RIGHT };
+  memset(config, 0, sizeof(configuration_t));
+  config->scroll.vert = true;
+  config->scroll.horz = true;
+  config->scroll.vert_delta = 79;
+  config->scroll.horz_delta = 30;
+  config->scroll.fingers = 2;
+  config->zoom.enabled = true;
+  config->zoom.delta = 200;
+  config->zoom.fingers = 2;
+  config->vert_threshold_percentage = 15;
+  config->horz_threshold_percentage = 15;
+  for (i = 0; i < MAX_FINGERS; i++) {
+    for (j = 0; j < BINDINGS_COUNT; j++) {
+      for (k = 0; k < MAX_KEYS_PER_GESTURE; k++) {
+        config->bindings[i][j].keys[k] = -1;
+      }
+    }
+    for (j = 0; j < DIRECTIONS_COUNT; j++) {
+      config->bindings[i][j].keys[0] = KEY_LEFTCTRL;
+      config->bindings[i][j].keys[1] = KEY_LEFTALT;
+      config->bindings[i][j].keys[2] = direction_keys[j];
+    }
+  }
+  compile_key_templates(config);
+}
+
+static int64_t monotonic_time_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// aligned, so the results of the threads don't share a cache line
+typedef struct bench_thread {
+  _Alignas(CACHE_LINE_SIZE) pthread_t thread;
+  const event_stream_t *stream;
+  configuration_t *config;
+  const device_info_t *info;
+  int64_t elapsed;
+  unsigned long allocations;
+  unsigned long emitted_events;
+} bench_thread_t;
+
+static void *feed_stream(void *data) {
+  bench_thread_t *bench = data;
+  const event_stream_t *stream = bench->stream;
+  size_t i, frame_start = 0;
+
+  gesture_recognizer_t *recognizer = create_gesture_recognizer(bench->info, bench->config, &count_events,
+                                                               &bench->emitted_events);
+  if (!recognizer) {
+    perror("error: create_gesture_recognizer");
+    exit(EXIT_FAILURE);
+  }
+  unsigned long start_allocations = allocations;
+  int64_t start = monotonic_time_ns();
+  // feed frame by frame like the event loop does for small reads
+  for (i = 0; i < stream->length; i++) {
+    if (stream->events[i].type == EV_SYN) {
+      feed_gesture_recognizer(recognizer, &stream->events[frame_start], i + 1 - frame_start);
+      frame_start = i + 1;
+    }
+  }
+  bench->elapsed = monotonic_time_ns() - start;
+  bench->allocations = allocations - start_allocations;
+  destroy_gesture_recognizer(recognizer);
+  return NULL;
+}
+
+static void run_scenario(const scenario_t *scenario, configuration_t *config, unsigned int gestures,
+                         unsigned int frames, unsigned int rate, unsigned int threads) {
+  bench_thread_t bench[MAX_THREADS];
+  device_info_t info;
+  event_stream_t stream;
+  unsigned int g, t;
+
+  memset(&info, 0, sizeof(info));
+  info.x.maximum = TOUCH_WIDTH;
+  info.y.maximum = TOUCH_HEIGHT;
+  memset(&stream, 0, sizeof(stream));
+  stream.time = 1000000000;
+  for (g = 0; g < gestures; g++) {
+    add_gesture(&stream, scenario, frames, rate);
+  }
+
+  memset(bench, 0, sizeof(bench));
+  for (t = 0; t < threads; t++) {
+    bench[t].stream = &stream;
+    bench[t].config = config;
+    bench[t].info = &info;
+    if (pthread_create(&bench[t].thread, NULL, &feed_stream, &bench[t]) != 0) {
+      perror("error: pthread_create");
+      exit(EXIT_FAILURE);
+    }
+  }
+  int64_t elapsed = 0;
+  unsigned long frame_allocations = 0, emitted_events = 0;
+  for (t = 0; t < threads; t++) {
+    pthread_join(bench[t].thread, NULL);
+    elapsed += bench[t].elapsed;
+    frame_allocations += bench[t].allocations;
+    emitted_events += bench[t].emitted_events;
+  }
+
+  printf("%-6s %u finger(s): %8.1f ns/frame %8.4f allocs/frame %6.1f events/gesture\n",
+         scenario->name, scenario->fingers, (double) elapsed / threads / stream.frames,
+         (double) frame_allocations / threads / stream.frames, (double) emitted_events / threads / gestures);
+
+  free(stream.events);
+}
+
+static void print_usage(const char *name) {
+  fprintf(stderr, "usage: %s [-g GESTURES] [-f FRAMES] [-r RATE] [-t THREADS]\n"
+          "  -g  gestures per scenario (default 10000)\n"
+          "  -f  frames of movement per gesture (default 30)\n"
+          "  -r  report rate of the simulated touch device in Hz (default 120)\n"
+          "  -t  threads that feed a recognizer each at the same time, the times are averaged (default 1)\n", name);
+}
+
+int main(int argc, char *argv[]) {
+  unsigned int gestures = 10000, frames = 30, rate = 120, threads = 1;
+  configuration_t config;
+  size_t i;
+  int option;
+
+  while ((option = getopt(argc, argv, "g:f:r:t:")) != -1) {
+    switch (option) {
+      case 'g':
+        gestures = (unsigned int) atoi(optarg);
+        break;
+      case 'f':
+        frames = (unsigned int) atoi(optarg);
+        break;
+      case 'r':
+        rate = (unsigned int) atoi(optarg);
+        break;
+      case 't':
+        threads = (unsigned int) atoi(optarg);
+        break;
+      default:
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+  }
+  if (gestures == 0 || frames == 0 || rate == 0 || threads == 0 || threads > MAX_THREADS) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  init_config(&config);
+  for (i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++) {
+    run_scenario(&scenarios[i], &config, gestures, frames, rate, threads);
+  }
+  return EXIT_SUCCESS;
+}
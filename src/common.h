@@ -29,6 +29,16 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+// size of the cache lines that the data of different threads must not share
+#define CACHE_LINE_SIZE 64
+
+#define BITS_PER_LONG (sizeof(long) * 8)
+#define NBITS(x) ((((x)-1)/BITS_PER_LONG)+1)
+#define OFF(x)  ((x)%BITS_PER_LONG)
+#define BIT(x)  (1UL<<OFF(x))
+#define LONG(x) ((x)/BITS_PER_LONG)
+#define test_bit(bit, array) ((array[LONG(bit)] >> OFF(bit)) & 1)
+
 #define die(str, args...) do { \
         perror(str); \
         exit(EXIT_FAILURE); \
@@ -24,81 +24,251 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <sched.h>
+#include <string.h>
+#include <strings.h>
 #include <iniparser.h>
 
+#include <linux/input.h>
+
 #include "configuraion.h"
 #include "common.h"
 #include "keys.h"
 
 
-char *directions[4] = { "up", "down", "left", "right" };
+char *bindings[BINDINGS_COUNT] = { "up", "down", "left", "right", "tap", "doubletap", "hold" };
 
 static void clean_config(configuration_t *config) {
   int i, j, k;
   for (i = 0; i < MAX_FINGERS; i++) {
-    for (j = 0; j < DIRECTIONS_COUNT; j++) {
+    for (j = 0; j < BINDINGS_COUNT; j++) {
       for (k = 0; k < MAX_KEYS_PER_GESTURE; k++) {
-        config->swipe_keys[i][j].keys[k] = -1;
+        config->bindings[i][j].keys[k] = -1;
       }
     }
   }
 }
 
-static void fill_keys_array(int (*keys_array)[MAX_KEYS_PER_GESTURE], char *keys) {
+static void compile_key_template(const keys_array_t *keys, key_template_t *template) {
+  unsigned int i, keys_count = 0;
+  memset(template, 0, sizeof(key_template_t));
+  for (i = 0; i < MAX_KEYS_PER_GESTURE; i++) {
+    if (keys->keys[i] > 0) {
+      keys_count++;
+    }
+  }
+  if (keys_count == 0) {
+    return;
+  }
+  struct input_event *press = template->events;
+  struct input_event *release = &template->events[keys_count + 1];
+  for (i = 0; i < MAX_KEYS_PER_GESTURE; i++) {
+    if (keys->keys[i] > 0) {
+      press->type = EV_KEY;
+      press->code = keys->keys[i];
+      press->value = 1;
+      press++;
+      release->type = EV_KEY;
+      release->code = keys->keys[i];
+      release++;
+    }
+  }
+  template->events[keys_count].type = EV_SYN;
+  template->events[keys_count].code = SYN_REPORT;
+  template->events[keys_count * 2 + 1].type = EV_SYN;
+  template->events[keys_count * 2 + 1].code = SYN_REPORT;
+  template->length = (keys_count + 1) * 2;
+}
+
+void compile_key_templates(configuration_t *config) {
+  unsigned int i, j;
+  for (i = 0; i < MAX_FINGERS; i++) {
+    for (j = 0; j < BINDINGS_COUNT; j++) {
+      compile_key_template(&config->bindings[i][j], &config->templates[i][j]);
+    }
+  }
+}
+
+static bool fill_keys_array(int (*keys_array)[MAX_KEYS_PER_GESTURE], char *keys) {
   if (keys) {
     char *ptr = strtok(keys, "+");
     unsigned int i = 0;
     while (ptr) {
       if (i >= MAX_KEYS_PER_GESTURE) {
         fprintf(stderr, "error: for each gesture only %d keystrokes are allowed\n", MAX_KEYS_PER_GESTURE);
-        exit(EXIT_FAILURE);
+        return false;
       }
       int key_code = get_key_code(ptr);
       if (key_code < 0) {
         fprintf(stderr, "error: wrong key name '%s'\n", ptr);
-        exit(EXIT_FAILURE);
+        return false;
       }
       (*keys_array)[i] = key_code;
       ptr = strtok(NULL, "+");
       i++;
     }
   }
+  return true;
 }
 
-configuration_t read_config(const char *filename) {
+static bool get_finger_count(dictionary *ini, char *key, int min, unsigned int *count) {
+  int result = iniparser_getint(ini, key, 2);
+  if (result < min || result > MAX_FINGERS) {
+    fprintf(stderr, "error: %s has to be between %d and %d\n", key, min, MAX_FINGERS);
+    return false;
+  }
+  *count = (unsigned int) result;
+  return true;
+}
+
+static bool get_scheduling_policy(char *name, int *policy) {
+  if (strcasecmp(name, "other") == 0) {
+    *policy = SCHED_OTHER;
+  } else if (strcasecmp(name, "fifo") == 0) {
+    *policy = SCHED_FIFO;
+  } else if (strcasecmp(name, "rr") == 0) {
+    *policy = SCHED_RR;
+  } else {
+    fprintf(stderr, "error: unknown scheduler '%s', use other, fifo or rr\n", name);
+    return false;
+  }
+  return true;
+}
+
+/*
+ * @return true if one finger touches are swipes or scrolling, a grabbed touch device
+ *         doesn't pass them on
+ */
+static bool uses_one_finger(const configuration_t *config) {
+  unsigned int i;
+  for (i = 0; i < DIRECTIONS_COUNT; i++) {
+    if (config->bindings[FINGER_TO_INDEX(1)][i].keys[0] > 0) {
+      return true;
+    }
+  }
+  return (config->scroll.vert || config->scroll.horz) && config->scroll.fingers == 1;
+}
+
+bool load_config(const char *filename, configuration_t *config) {
   configuration_t result;
   clean_config(&result);
   dictionary *ini = iniparser_load(filename);
-  char *touch_device_path = iniparser_getstring(ini, "general:touchdevice", NULL);
-  if (touch_device_path) {
-    if (result.touch_device_path = malloc(strlen(touch_device_path) + 1)) {
-      strcpy(result.touch_device_path, touch_device_path);
-    }
-  } else {
-    result.touch_device_path = NULL;
+  if (!ini) {
+    fprintf(stderr, "error: can't read the configuration file %s\n", filename);
+    return false;
   }
-  result.retries = (unsigned int) iniparser_getint(ini, "general:retries", 2);
-  result.retry_delay = (unsigned int) iniparser_getint(ini, "general:retrydelay", 5);
+  char *touch_device_path = iniparser_getstring(ini, "general:touchdevice", NULL);
+  result.touch_device_path = touch_device_path ? strdup(touch_device_path) : NULL;
+  char *metrics_socket_path = iniparser_getstring(ini, "general:metricssocket", NULL);
+  result.metrics_socket_path = metrics_socket_path ? strdup(metrics_socket_path) : NULL;
+  result.grab = iniparser_getboolean(ini, "general:grab", false);
+  char *cpus = iniparser_getstring(ini, "general:cpus", NULL);
+  result.realtime.cpus = cpus ? strdup(cpus) : NULL;
+  result.realtime.priority = iniparser_getint(ini, "general:priority", 10);
+  result.realtime.lock_memory = iniparser_getboolean(ini, "general:lockmemory", false);
+  result.realtime.busy_poll = (unsigned int) iniparser_getint(ini, "general:busypoll", 0);
+  result.realtime.emitter_thread = iniparser_getboolean(ini, "general:emitterthread", false);
   result.scroll.vert = iniparser_getboolean(ini, "scroll:vertical", false);
   result.scroll.horz = iniparser_getboolean(ini, "scroll:horizontal", false);
   result.scroll.vert_delta = (int) iniparser_getint(ini, "scroll:verticaldelta", 79);
   result.scroll.horz_delta = (int) iniparser_getint(ini, "scroll:horizontaldelta", 30);
   result.scroll.invert_vert = iniparser_getboolean(ini, "scroll:invertvertical", false);
   result.scroll.invert_horz = iniparser_getboolean(ini, "scroll:inverthorizontal", false);
+  result.scroll.hi_res = iniparser_getboolean(ini, "scroll:highresolution", false);
   result.vert_threshold_percentage = iniparser_getint(ini, "thresholds:vertical", 15);
   result.horz_threshold_percentage = iniparser_getint(ini, "thresholds:horizontal", 15);
+  result.prediction_percentage = (unsigned int) iniparser_getint(ini, "thresholds:predict", 0);
   result.zoom.enabled = iniparser_getboolean(ini, "zoom:enabled", false);
   result.zoom.delta = (unsigned int) iniparser_getint(ini, "zoom:delta", 200);
+  result.zoom.hold_modifier = iniparser_getboolean(ini, "zoom:holdmodifier", false);
+  result.palm.size = iniparser_getint(ini, "palm:size", 0);
+  result.palm.pressure = iniparser_getint(ini, "palm:pressure", 0);
+  result.palm.edge = (unsigned int) iniparser_getint(ini, "palm:edge", 0);
+  bool valid = get_scheduling_policy(iniparser_getstring(ini, "general:scheduler", "other"), &result.realtime.policy) &&
+    get_finger_count(ini, "scroll:fingers", 1, &result.scroll.fingers) &&
+    get_finger_count(ini, "zoom:fingers", 2, &result.zoom.fingers);
 
   unsigned int i, j;
   for (i = 0; i < MAX_FINGERS; i++) {
-    for (j = 0; j < DIRECTIONS_COUNT; j++) {
-      char ini_key[16];
-      sprintf(ini_key, "%d-fingers:%s", INDEX_TO_FINGER(i), directions[j]);
-      fill_keys_array(&result.swipe_keys[i][j].keys, iniparser_getstring(ini, ini_key, NULL));
+    for (j = 0; j < BINDINGS_COUNT; j++) {
+      char ini_key[32];
+      sprintf(ini_key, "%d-fingers:%s", INDEX_TO_FINGER(i), bindings[j]);
+      valid = valid && fill_keys_array(&result.bindings[i][j].keys, iniparser_getstring(ini, ini_key, NULL));
     }
   }
 
   iniparser_freedict(ini);
+  if (!valid) {
+    free_config(&result);
+    return false;
+  }
+  if (result.grab && uses_one_finger(&result)) {
+    fprintf(stderr, "warning: with Grab one finger swipes and scrolling keep the pointer from moving\n");
+  }
+  compile_key_templates(&result);
+  *config = result;
+  return true;
+}
+
+configuration_t read_config(const char *filename) {
+  configuration_t result;
+  if (!load_config(filename, &result)) {
+    exit(EXIT_FAILURE);
+  }
   return result;
 }
+
+void free_config(configuration_t *config) {
+  free(config->touch_device_path);
+  free(config->metrics_socket_path);
+  free(config->realtime.cpus);
+  config->realtime.cpus = NULL;
+  config->touch_device_path = NULL;
+  config->metrics_socket_path = NULL;
+}
+
+static bool is_key_supported(const configuration_t *supported, int key) {
+  unsigned int i, j, k;
+  if (supported->zoom.enabled && key == KEY_LEFTCTRL) {
+    return true;
+  }
+  for (i = 0; i < MAX_FINGERS; i++) {
+    for (j = 0; j < BINDINGS_COUNT; j++) {
+      for (k = 0; k < MAX_KEYS_PER_GESTURE; k++) {
+        if (supported->bindings[i][j].keys[k] == key) {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+void restrict_config(configuration_t *config, const configuration_t *supported) {
+  unsigned int i, j, k;
+  for (i = 0; i < MAX_FINGERS; i++) {
+    for (j = 0; j < BINDINGS_COUNT; j++) {
+      keys_array_t *keys = &config->bindings[i][j];
+      for (k = 0; k < MAX_KEYS_PER_GESTURE; k++) {
+        if (keys->keys[k] != -1 && !is_key_supported(supported, keys->keys[k])) {
+          fprintf(stderr, "warning: key %d of %d-fingers:%s isn't registered, restart to use it\n",
+                  keys->keys[k], INDEX_TO_FINGER(i), bindings[j]);
+          // a gesture with only some of its keys would be misleading
+          for (k = 0; k < MAX_KEYS_PER_GESTURE; k++) {
+            keys->keys[k] = -1;
+          }
+          break;
+        }
+      }
+    }
+  }
+  if (config->zoom.enabled && !is_key_supported(supported, KEY_LEFTCTRL)) {
+    fprintf(stderr, "warning: zooming wasn't enabled at startup, restart to use it\n");
+    config->zoom.enabled = false;
+  }
+  if (config->scroll.hi_res && !supported->scroll.hi_res) {
+    fprintf(stderr, "warning: high resolution scrolling wasn't enabled at startup, restart to use it\n");
+    config->scroll.hi_res = false;
+  }
+  compile_key_templates(config);
+}
@@ -29,20 +29,45 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include <linux/input.h>
+
 #include "int_array.h"
 
 #define MAX_FINGERS           5
 #define DIRECTIONS_COUNT      4
+#define TAPS_COUNT            3
+// the swipe directions followed by the taps
+#define BINDINGS_COUNT        (DIRECTIONS_COUNT + TAPS_COUNT)
 #define MAX_KEYS_PER_GESTURE  5
 
 typedef struct keys_array {
   int keys[MAX_KEYS_PER_GESTURE];
 } keys_array_t;
 
+// the ready to send events of a binding: all keys pressed, SYN_REPORT, all keys released, SYN_REPORT
+typedef struct key_template {
+  // 0 if nothing is bound
+  unsigned int length;
+  struct input_event events[(MAX_KEYS_PER_GESTURE + 1) * 2];
+} key_template_t;
+
 typedef struct configuration {
   char *touch_device_path;
-  unsigned int retries;
-  unsigned int retry_delay;
+  char *metrics_socket_path;
+  // grab the touch devices and pass the touches without gestures on to a virtual touch device
+  bool grab;
+  struct realtime_options {
+    // SCHED_OTHER, SCHED_FIFO or SCHED_RR
+    int policy;
+    int priority;
+    bool lock_memory;
+    // list of CPUs like "0,2-3", NULL to run on all
+    char *cpus;
+    // microseconds to poll for new events before sleeping, 0 to always sleep
+    unsigned int busy_poll;
+    // write to uinput from a separate thread
+    bool emitter_thread;
+  } realtime;
   struct scroll_options {
     bool vert;
     bool horz;
@@ -50,19 +75,58 @@ typedef struct configuration {
     int horz_delta;
     bool invert_vert;
     bool invert_horz;
+    unsigned int fingers;
+    // emit REL_WHEEL_HI_RES/REL_HWHEEL_HI_RES in addition to the normal wheel events
+    bool hi_res;
   } scroll;
   struct zoom_options {
     bool enabled;
     unsigned int delta;
+    unsigned int fingers;
+    // press KEY_LEFTCTRL once for the whole gesture instead of for every zoom event
+    bool hold_modifier;
   } zoom;
+  struct palm_options {
+    // minimal ABS_MT_TOUCH_MAJOR of a palm, 0 to disable
+    int size;
+    // minimal ABS_MT_PRESSURE of a palm, 0 to disable
+    int pressure;
+    // width of the left, right and bottom edge in percent where thumbs rest
+    unsigned int edge;
+  } palm;
   unsigned int vert_threshold_percentage;
   unsigned int horz_threshold_percentage;
-  keys_array_t swipe_keys[MAX_FINGERS][DIRECTIONS_COUNT];
+  // percentage of the thresholds after which a fast swipe is sent early, 0 to disable
+  unsigned int prediction_percentage;
+  // indexed by the direction_t or TAP_BINDING(tap_t)
+  keys_array_t bindings[MAX_FINGERS][BINDINGS_COUNT];
+  // built from the bindings whenever they change
+  key_template_t templates[MAX_FINGERS][BINDINGS_COUNT];
 } configuration_t;
 
 typedef enum direction { UP, DOWN, LEFT, RIGHT, NONE } direction_t;
+typedef enum tap { TAP, DOUBLE_TAP, TAP_AND_HOLD } tap_t;
+
+#define TAP_BINDING(tap) (DIRECTIONS_COUNT + tap)
 
+/*
+ * Exits if the configuration file is invalid.
+ */
 configuration_t read_config(const char *filename);
+/*
+ * @return false if the configuration file is invalid, config is left untouched then
+ */
+bool load_config(const char *filename, configuration_t *config);
+void free_config(configuration_t *config);
+/*
+ * Disables the parts of config that need keys or axes the uinput device,
+ * which was created for the supported configuration, doesn't have.
+ */
+void restrict_config(configuration_t *config, const configuration_t *supported);
+/*
+ * Builds the templates from the bindings, has to be called after they changed.
+ */
+void compile_key_templates(configuration_t *config);
 
 #define FINGER_TO_INDEX(finger) (finger - 1)
 #define INDEX_TO_FINGER(index) (index + 1)
@@ -0,0 +1,77 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2014 Robin Müller.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <time.h>
+
+#include "common.h"
+#include "emit_buffer.h"
+#include "metrics.h"
+
+emit_buffer_t *new_emit_buffer(size_t capacity, flush_callback_t flush, void *data) {
+  emit_buffer_t *buffer = malloc(sizeof(emit_buffer_t));
+  if (!buffer) {
+    return NULL;
+  }
+  buffer->events = new_input_event_array(capacity);
+  if (!buffer->events) {
+    free(buffer);
+    return NULL;
+  }
+  buffer->capacity = capacity;
+  buffer->events->length = 0;
+  buffer->flush = flush;
+  buffer->data = data;
+  buffer->source_time = 0;
+  return buffer;
+}
+
+void free_emit_buffer(emit_buffer_t *buffer) {
+  free(buffer->events);
+  free(buffer);
+}
+
+void flush_emit_buffer(emit_buffer_t *buffer) {
+  if (buffer->events->length > 0) {
+    buffer->flush(buffer->events, buffer->data);
+    buffer->events->length = 0;
+    if (buffer->source_time > 0) {
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      observe_latency(&metrics.latency, (int64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000 - buffer->source_time);
+    }
+  }
+}
+
+struct input_event *reserve_events(emit_buffer_t *buffer, size_t count) {
+  if (count > buffer->capacity) {
+    return NULL;
+  }
+  if (buffer->events->length + count > buffer->capacity) {
+    flush_emit_buffer(buffer);
+  }
+  struct input_event *result = &buffer->events->data[buffer->events->length];
+  buffer->events->length += count;
+  return result;
+}
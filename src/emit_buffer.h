@@ -0,0 +1,65 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2014 Robin Müller.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef EMIT_BUFFER_H_
+#define EMIT_BUFFER_H_
+
+#include <stdint.h>
+
+#include "input_event_array.h"
+
+/*
+ * Receives the flushed events together with the data given to new_emit_buffer.
+ */
+typedef void (*flush_callback_t)(input_event_array_t *events, void *data);
+
+/*
+ * Collects the events of several frames, so that they can be passed to the
+ * flush callback (and therefore written to uinput) at once.
+ */
+typedef struct emit_buffer {
+  size_t capacity;
+  input_event_array_t *events;
+  flush_callback_t flush;
+  void *data;
+  // CLOCK_MONOTONIC timestamp (microseconds) of the oldest input event that may
+  // have caused the buffered events, 0 if unknown
+  int64_t source_time;
+} emit_buffer_t;
+
+emit_buffer_t *new_emit_buffer(size_t capacity, flush_callback_t flush, void *data);
+void free_emit_buffer(emit_buffer_t *buffer);
+/*
+ * Reserves space for count events at the end of the buffer. If they don't fit
+ * anymore the buffer is flushed first.
+ * @return pointer to the first reserved event or NULL if count exceeds the capacity
+ */
+struct input_event *reserve_events(emit_buffer_t *buffer, size_t count);
+/*
+ * Passes the buffered events to the flush callback. If source_time is set, the
+ * time since then is observed as latency.
+ */
+void flush_emit_buffer(emit_buffer_t *buffer);
+
+#endif // EMIT_BUFFER_H_
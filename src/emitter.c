@@ -0,0 +1,194 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2014 Robin Müller.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "common.h"
+#include "emitter.h"
+#include "gestures_device.h"
+#include "metrics.h"
+
+/*
+ * Single producer, single consumer ring of input events. The producer only
+ * writes head and the consumer only writes tail, both grow without bounds and
+ * are masked to index the events.
+ */
+struct emitter {
+  // written by the reader thread
+  _Alignas(CACHE_LINE_SIZE) atomic_size_t head;
+  // written by the emitter thread
+  _Alignas(CACHE_LINE_SIZE) atomic_size_t tail;
+  // the emitter thread waits on wakeup_fd while this is set
+  atomic_bool sleeping;
+  atomic_bool stopped;
+  _Alignas(CACHE_LINE_SIZE) int fd;
+  int wakeup_fd;
+  size_t mask;
+  pthread_t thread;
+  struct input_event *events;
+};
+
+static void wake_up(emitter_t *emitter) {
+  uint64_t value = 1;
+  if (write(emitter->wakeup_fd, &value, sizeof(value)) < 0) {
+    die("error: write eventfd");
+  }
+}
+
+/*
+ * @return the number of queued events, or 0 after the emitter thread waited for new ones
+ */
+static size_t wait_for_events(emitter_t *emitter, size_t tail) {
+  size_t head = atomic_load_explicit(&emitter->head, memory_order_acquire);
+  if (head != tail) {
+    return head - tail;
+  }
+  atomic_store(&emitter->sleeping, true);
+  // events queued before sleeping was set wouldn't wake the thread up
+  head = atomic_load(&emitter->head);
+  if (head != tail || atomic_load(&emitter->stopped)) {
+    atomic_store(&emitter->sleeping, false);
+    return head - tail;
+  }
+  uint64_t value;
+  if (read(emitter->wakeup_fd, &value, sizeof(value)) < 0) {
+    die("error: read eventfd");
+  }
+  return 0;
+}
+
+static void *run_emitter(void *data) {
+  emitter_t *emitter = data;
+  size_t tail = atomic_load_explicit(&emitter->tail, memory_order_relaxed);
+  for (;;) {
+    size_t count = wait_for_events(emitter, tail);
+    if (count == 0) {
+      if (atomic_load(&emitter->stopped) &&
+          atomic_load_explicit(&emitter->head, memory_order_acquire) == tail) {
+        break;
+      }
+      continue;
+    }
+    // the events up to the end of the ring, the rest follows with the next iteration
+    size_t index = tail & emitter->mask;
+    if (index + count > emitter->mask + 1) {
+      count = emitter->mask + 1 - index;
+    }
+    write_events(emitter->fd, &emitter->events[index], count);
+    tail += count;
+    atomic_store_explicit(&emitter->tail, tail, memory_order_release);
+  }
+  return NULL;
+}
+
+emitter_t *start_emitter(int fd, size_t capacity) {
+  size_t size = 1;
+  while (size < capacity) {
+    size <<= 1;
+  }
+  emitter_t *emitter = aligned_alloc(CACHE_LINE_SIZE, sizeof(emitter_t));
+  if (!emitter) {
+    return NULL;
+  }
+  emitter->events = malloc(size * sizeof(struct input_event));
+  emitter->wakeup_fd = eventfd(0, EFD_CLOEXEC);
+  if (!emitter->events || emitter->wakeup_fd < 0) {
+    goto error;
+  }
+  atomic_init(&emitter->head, 0);
+  atomic_init(&emitter->tail, 0);
+  atomic_init(&emitter->sleeping, false);
+  atomic_init(&emitter->stopped, false);
+  emitter->fd = fd;
+  emitter->mask = size - 1;
+  if (pthread_create(&emitter->thread, NULL, &run_emitter, emitter) != 0) {
+    goto error;
+  }
+  return emitter;
+
+error:
+  if (emitter->wakeup_fd >= 0) {
+    close(emitter->wakeup_fd);
+  }
+  free(emitter->events);
+  free(emitter);
+  return NULL;
+}
+
+void queue_events(emitter_t *emitter, input_event_array_t *input_events) {
+  size_t head = atomic_load_explicit(&emitter->head, memory_order_relaxed);
+  size_t capacity = emitter->mask + 1;
+  size_t i = 0;
+  while (i < input_events->length) {
+    size_t used = head - atomic_load_explicit(&emitter->tail, memory_order_acquire);
+    if (used == capacity) {
+      // the emitter thread doesn't keep up, wait for it instead of dropping events
+      count_metric(emit_queue_stalls, 1);
+      atomic_store_explicit(&emitter->head, head, memory_order_release);
+      if (atomic_exchange(&emitter->sleeping, false)) {
+        wake_up(emitter);
+      }
+      while (head - atomic_load_explicit(&emitter->tail, memory_order_acquire) == capacity) {
+        sched_yield();
+      }
+      continue;
+    }
+    size_t count = capacity - used;
+    if (count > input_events->length - i) {
+      count = input_events->length - i;
+    }
+    size_t j;
+    for (j = 0; j < count; j++) {
+      emitter->events[(head + j) & emitter->mask] = input_events->data[i + j];
+    }
+    head += count;
+    i += count;
+  }
+  // all events of the batch become visible to the emitter thread at once, sequentially
+  // consistent so that it is ordered with the check of sleeping below
+  atomic_store(&emitter->head, head);
+  size_t queued = head - atomic_load_explicit(&emitter->tail, memory_order_relaxed);
+  if (queued > atomic_load_explicit(&metrics.emit_queue_peak, memory_order_relaxed)) {
+    atomic_store_explicit(&metrics.emit_queue_peak, queued, memory_order_relaxed);
+  }
+  if (atomic_exchange(&emitter->sleeping, false)) {
+    wake_up(emitter);
+  }
+}
+
+void stop_emitter(emitter_t *emitter) {
+  atomic_store(&emitter->stopped, true);
+  wake_up(emitter);
+  pthread_join(emitter->thread, NULL);
+  close(emitter->wakeup_fd);
+  free(emitter->events);
+  free(emitter);
+}
@@ -0,0 +1,50 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2014 Robin Müller.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef EMITTER_H_
+#define EMITTER_H_
+
+#include <stddef.h>
+
+#include "input_event_array.h"
+
+typedef struct emitter emitter_t;
+
+/*
+ * Starts a thread that writes the queued events to the uinput device fd.
+ * @param capacity number of events the queue can hold, rounded up to a power of 2
+ * @return NULL if the thread can't be started
+ */
+emitter_t *start_emitter(int fd, size_t capacity);
+/*
+ * Queues the events for the emitter thread. Must only be called by one thread.
+ * If the queue is full it waits until the emitter thread made room.
+ */
+void queue_events(emitter_t *emitter, input_event_array_t *input_events);
+/*
+ * Writes the events that are still queued and stops the thread.
+ */
+void stop_emitter(emitter_t *emitter);
+
+#endif // EMITTER_H_
@@ -0,0 +1,694 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2014 Robin Müller.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sys/signalfd.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include <linux/input.h>
+
+#include "common.h"
+#include "event_loop.h"
+#include "gesture_detection.h"
+#include "gestures_device.h"
+#include "hotplug.h"
+#include "metrics.h"
+#include "trace.h"
+
+#define MAX_EVENTS_PER_READ 64
+// button events of one frame that are passed on while the touch is consumed
+#define MAX_BUTTON_EVENTS 8
+// enough for the output of a whole read() batch in most cases
+#define EMIT_BUFFER_CAPACITY 256
+
+// lets the other hyper-thread of the core run while busy polling
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define cpu_relax() __asm__ __volatile__("yield")
+#else
+#define cpu_relax()
+#endif
+
+typedef enum event_source_type {
+  DEVICE_SOURCE,
+  SCROLL_TIMER_SOURCE,
+  TAP_TIMER_SOURCE,
+  SIGNAL_SOURCE,
+  METRICS_SOURCE,
+  CONFIG_SOURCE,
+  UEVENT_SOURCE
+} event_source_type_t;
+
+// the epoll data of every watched fd points to one of those
+typedef struct event_source {
+  event_source_type_t type;
+  // NULL for sources that don't belong to a device
+  struct touch_device *device;
+} event_source_t;
+
+typedef struct touch_device {
+  // -1 while the device isn't attached
+  int fd;
+  // the device node and id, to recognize the device when it is plugged in again
+  dev_t rdev;
+  struct input_id id;
+  // the input event timestamps use CLOCK_MONOTONIC
+  bool monotonic;
+  // NULL for unused slots, a detached device keeps its state parked
+  gesture_state_t *state;
+  trace_writer_t *trace;
+  event_source_t device_source;
+  event_source_t timer_source;
+  event_source_t tap_timer_source;
+  // the virtual touch device of a grabbed device, -1 if it isn't grabbed
+  int passthrough_fd;
+  // the passthrough device got contacts since the last consumed touch
+  bool forwarding;
+  // the last selected ABS_MT_SLOT and the number of slots
+  int mt_slot;
+  unsigned int slots;
+} touch_device_t;
+
+typedef struct event_loop {
+  int epoll_fd;
+  touch_device_t devices[MAX_TOUCH_DEVICES];
+  unsigned int active_devices;
+  // the number of devices opened at startup
+  unsigned int initial_devices;
+  configuration_t *config;
+  emit_buffer_t *emit_buffer;
+  const char *record_path;
+  // microseconds to poll before sleeping in epoll_wait(), 0 to always sleep
+  unsigned int busy_poll;
+  bool grab;
+} event_loop_t;
+
+static int64_t monotonic_time_us(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static void watch_fd(int epoll_fd, int fd, event_source_t *source) {
+  struct epoll_event epoll_event = {
+    .events = EPOLLIN,
+    .data.ptr = source
+  };
+  if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &epoll_event) < 0) {
+    die("error: epoll_ctl");
+  }
+}
+
+/*
+ * Stops reading from the device, but keeps its state until it is plugged in again.
+ */
+static void park_device(event_loop_t *loop, touch_device_t *device) {
+  // keys held by a gesture must not stay pressed
+  park_gesture_state(device->state, loop->emit_buffer);
+  flush_emit_buffer(loop->emit_buffer);
+  epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, device->fd, NULL);
+  epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, get_scroll_timer_fd(device->state), NULL);
+  epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, get_tap_timer_fd(device->state), NULL);
+  close(device->fd);
+  device->fd = -1;
+  if (device->passthrough_fd >= 0) {
+    destroy_uinput(device->passthrough_fd);
+    device->passthrough_fd = -1;
+  }
+  loop->active_devices--;
+}
+
+static void remove_device(event_loop_t *loop, touch_device_t *device) {
+  if (device->fd >= 0) {
+    park_device(loop, device);
+  }
+  free_gesture_state(device->state);
+  if (device->trace) {
+    close_trace_writer(device->trace);
+    device->trace = NULL;
+  }
+  device->state = NULL;
+}
+
+/*
+ * Passes the button events of a consumed frame on, so clicks keep working
+ * while the touch is a gesture.
+ */
+static void forward_buttons(touch_device_t *device, const struct input_event *events, size_t count) {
+  struct input_event buttons[MAX_BUTTON_EVENTS + 1];
+  size_t i, length = 0;
+  for (i = 0; i < count && length < MAX_BUTTON_EVENTS; i++) {
+    if (events[i].type == EV_KEY && (events[i].code == BTN_LEFT || events[i].code == BTN_RIGHT ||
+                                     events[i].code == BTN_MIDDLE)) {
+      buttons[length++] = events[i];
+    }
+  }
+  if (length > 0) {
+    memset(&buttons[length], 0, sizeof(struct input_event));
+    buttons[length].type = EV_SYN;
+    buttons[length++].code = SYN_REPORT;
+    forward_events(device->passthrough_fd, buttons, length);
+  }
+}
+
+/*
+ * Feeds the events of a grabbed device frame by frame to the recognizer. The
+ * frames of touches it doesn't consume are passed on to the passthrough device.
+ */
+static void process_grabbed_events(touch_device_t *device, struct input_event *events, size_t count,
+                                   emit_buffer_t *emit_buffer) {
+  size_t start = 0, i;
+  for (i = 0; i < count; i++) {
+    if (events[i].type == EV_ABS && events[i].code == ABS_MT_SLOT) {
+      device->mt_slot = events[i].value;
+    }
+    // the rest of a frame that didn't fit into the read() follows with the next one
+    if ((events[i].type != EV_SYN || events[i].code != SYN_REPORT) && i < count - 1) {
+      continue;
+    }
+    size_t length = i + 1 - start;
+    process_events(device->state, &events[start], length, emit_buffer);
+    if (!is_touch_consumed(device->state)) {
+      forward_events(device->passthrough_fd, &events[start], length);
+      device->forwarding = true;
+    } else {
+      // the contacts would stay on the passthrough device until the gesture ends otherwise
+      if (device->forwarding) {
+        release_passthrough_contacts(device->passthrough_fd, device->slots, device->mt_slot);
+        device->forwarding = false;
+      }
+      forward_buttons(device, &events[start], length);
+    }
+    start = i + 1;
+  }
+}
+
+/*
+ * @return false if the device can't be read anymore
+ */
+static bool read_device(touch_device_t *device, emit_buffer_t *emit_buffer, wakeup_t wakeup) {
+  struct input_event ev[MAX_EVENTS_PER_READ];
+  int rd = read(device->fd, ev, sizeof(ev));
+
+  if (rd < 0 && errno == EAGAIN) {
+    return true;
+  } else if (rd < 0 && errno == ENODEV) {
+    printf("Input device %04x:%04x disconnected\n", device->id.vendor, device->id.product);
+    return false;
+  } else if (rd < (int) sizeof(struct input_event)) {
+    printf("expected %d bytes, got %d\n", (int) sizeof(struct input_event), rd);
+    return false;
+  }
+  count_metric(reads, 1);
+  count_metric(read_bytes, rd);
+  if (device->monotonic) {
+    observe_latency(&metrics.wakeup_latency[wakeup], monotonic_time_us() - event_time_us(ev[0]));
+  }
+  if (device->trace) {
+    write_trace_events(device->trace, ev, rd / sizeof(struct input_event));
+  }
+  emit_buffer->source_time = device->monotonic ? event_time_us(ev[0]) : 0;
+  if (device->passthrough_fd >= 0) {
+    process_grabbed_events(device, ev, rd / sizeof(struct input_event), emit_buffer);
+  } else {
+    process_events(device->state, ev, rd / sizeof(struct input_event), emit_buffer);
+  }
+  // all frames of one read() batch are sent together
+  flush_emit_buffer(emit_buffer);
+  emit_buffer->source_time = 0;
+  return true;
+}
+
+static trace_writer_t *open_device_trace(event_loop_t *loop, unsigned int index, const device_info_t *info) {
+  char filename[4096];
+  // with several devices every one gets its own trace file
+  if (loop->initial_devices > 1 || index > 0) {
+    snprintf(filename, sizeof(filename), "%s.%u", loop->record_path, index);
+  } else {
+    snprintf(filename, sizeof(filename), "%s", loop->record_path);
+  }
+  trace_writer_t *trace = open_trace_writer(filename, info);
+  if (!trace) {
+    die("error: open_trace_writer");
+  }
+  printf("Recording input device %u to %s\n", index, filename);
+  return trace;
+}
+
+/*
+ * @return the slot for the device with the given id, the parked state of the
+ *         same device if there is one, or NULL if all slots are used
+ */
+static touch_device_t *get_device_slot(event_loop_t *loop, const struct input_id *id) {
+  touch_device_t *result = NULL;
+  unsigned int i;
+  for (i = 0; i < MAX_TOUCH_DEVICES; i++) {
+    touch_device_t *device = &loop->devices[i];
+    if (device->state && device->fd < 0 && memcmp(&device->id, id, sizeof(*id)) == 0) {
+      return device;
+    } else if (!device->state && !result) {
+      result = device;
+    }
+  }
+  return result;
+}
+
+/*
+ * Grabs the device exclusively and creates its passthrough device. Without the
+ * passthrough device the device is used without grabbing it.
+ */
+static void grab_device(touch_device_t *device, const device_info_t *info) {
+  if (ioctl(device->fd, EVIOCGRAB, (void*)1) < 0) {
+    fprintf(stderr, "warning: can't grab input device %04x:%04x\n", device->id.vendor, device->id.product);
+    return;
+  }
+  device->passthrough_fd = init_passthrough_uinput(device->fd);
+  if (device->passthrough_fd < 0) {
+    fprintf(stderr, "warning: can't create the passthrough device of input device %04x:%04x\n",
+            device->id.vendor, device->id.product);
+    ioctl(device->fd, EVIOCGRAB, (void*)0);
+    return;
+  }
+  device->forwarding = false;
+  device->mt_slot = info->slot.value;
+  device->slots = info->slot.maximum > 0 && info->slot.maximum < MAX_SLOTS ? info->slot.maximum + 1 : MAX_SLOTS;
+}
+
+/*
+ * @return false if all events of the device are needed: a grabbed device
+ *         passes them on and a recorded trace may be replayed with another
+ *         configuration
+ */
+static bool is_event_mask_allowed(const touch_device_t *device) {
+  return device->passthrough_fd < 0 && !device->trace;
+}
+
+/*
+ * Starts reading from an opened touch device.
+ * @return false if the device can't be used, fd is closed then
+ */
+static bool attach_device(event_loop_t *loop, int fd) {
+  device_info_t info;
+  struct input_id id;
+  struct stat st;
+  if (!query_device_info(fd, &info) || ioctl(fd, EVIOCGID, &id) < 0 || fstat(fd, &st) < 0) {
+    close(fd);
+    return false;
+  }
+  touch_device_t *device = get_device_slot(loop, &id);
+  if (!device) {
+    close(fd);
+    return false;
+  }
+  unsigned int index = device - loop->devices;
+  if (!device->state) {
+    device->state = new_gesture_state(&info, loop->config);
+    if (!device->state) {
+      close(fd);
+      return false;
+    }
+    if (loop->record_path) {
+      device->trace = open_device_trace(loop, index, &info);
+    }
+  } else {
+    printf("Input device %04x:%04x reconnected\n", id.vendor, id.product);
+  }
+  device->fd = fd;
+  device->rdev = st.st_rdev;
+  device->id = id;
+  // a removed device must not block the event loop
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  int clock_id = CLOCK_MONOTONIC;
+  device->monotonic = ioctl(device->fd, EVIOCSCLOCKID, &clock_id) == 0;
+  device->device_source.type = DEVICE_SOURCE;
+  device->device_source.device = device;
+  device->timer_source.type = SCROLL_TIMER_SOURCE;
+  device->timer_source.device = device;
+  device->tap_timer_source.type = TAP_TIMER_SOURCE;
+  device->tap_timer_source.device = device;
+  watch_fd(loop->epoll_fd, device->fd, &device->device_source);
+  watch_fd(loop->epoll_fd, get_scroll_timer_fd(device->state), &device->timer_source);
+  watch_fd(loop->epoll_fd, get_tap_timer_fd(device->state), &device->tap_timer_source);
+  if (loop->grab) {
+    grab_device(device, &info);
+  }
+  if (is_event_mask_allowed(device)) {
+    set_event_mask(device->fd, loop->config);
+  }
+  loop->active_devices++;
+  return true;
+}
+
+static bool is_attached(event_loop_t *loop, const char *path) {
+  struct stat st;
+  unsigned int i;
+  if (stat(path, &st) < 0) {
+    return false;
+  }
+  for (i = 0; i < MAX_TOUCH_DEVICES; i++) {
+    if (loop->devices[i].fd >= 0 && loop->devices[i].rdev == st.st_rdev) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * Attaches the input device that was just plugged in if it is a touch device to use.
+ * The kernel and udev both report it, so it may be attached already.
+ */
+static void process_new_device(event_loop_t *loop, const char *path) {
+  if (is_attached(loop, path) || !is_touch_device(loop->config, path)) {
+    return;
+  }
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  if (!attach_device(loop, fd)) {
+    fprintf(stderr, "error: input device %s can't be used for gesture detection\n", path);
+  }
+}
+
+/*
+ * SIGINT and SIGTERM are handled by the event loop to shut down cleanly.
+ */
+static int create_signal_fd(void) {
+  sigset_t mask;
+  sigemptyset(&mask);
+  sigaddset(&mask, SIGINT);
+  sigaddset(&mask, SIGTERM);
+  if (sigprocmask(SIG_BLOCK, &mask, NULL) < 0) {
+    die("error: sigprocmask");
+  }
+  int fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+  if (fd < 0) {
+    die("error: signalfd");
+  }
+  return fd;
+}
+
+/*
+ * The directory of the configuration file is watched, because editors often
+ * replace the file instead of writing to it.
+ * @return -1 if the file can't be watched
+ */
+static int create_config_watch(const char *path) {
+  char directory[4096];
+  const char *separator = strrchr(path, '/');
+  if (separator) {
+    snprintf(directory, sizeof(directory), "%.*s", (int) (separator - path + 1), path);
+  } else {
+    snprintf(directory, sizeof(directory), ".");
+  }
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0) {
+    return -1;
+  }
+  if (inotify_add_watch(fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/*
+ * @return true if one of the pending inotify events is about the configuration file
+ */
+static bool is_config_changed(int fd, const char *path) {
+  char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  const char *separator = strrchr(path, '/');
+  const char *name = separator ? separator + 1 : path;
+  bool result = false;
+  ssize_t length;
+  while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+    char *ptr = buffer;
+    while (ptr < buffer + length) {
+      struct inotify_event *event = (struct inotify_event*) ptr;
+      if (event->len > 0 && strcmp(event->name, name) == 0) {
+        result = true;
+      }
+      ptr += sizeof(struct inotify_event) + event->len;
+    }
+  }
+  return result;
+}
+
+/*
+ * @return the new configuration or NULL if the file is invalid
+ */
+static configuration_t *reload_config(const char *path, const configuration_t *supported) {
+  configuration_t *config = malloc(sizeof(configuration_t));
+  if (!config) {
+    die("error: malloc");
+  }
+  if (!load_config(path, config)) {
+    fprintf(stderr, "error: keeping the previous configuration\n");
+    free(config);
+    return NULL;
+  }
+  // the uinput device keeps the keys it was created with
+  restrict_config(config, supported);
+  printf("Reloaded configuration from %s\n", path);
+  fflush(stdout);
+  return config;
+}
+
+/*
+ * Waits for events on the epoll instance. With busy polling the events are
+ * polled without sleeping for half the time, then the CPU is yielded between
+ * the polls until the time is up and only then epoll_wait() sleeps.
+ * @return the number of events like epoll_wait()
+ */
+static int wait_for_events(event_loop_t *loop, struct epoll_event *events, wakeup_t *wakeup) {
+  if (loop->busy_poll > 0) {
+    int64_t start = monotonic_time_us();
+    for (;;) {
+      int n = epoll_wait(loop->epoll_fd, events, MAX_EVENTS_PER_READ, 0);
+      if (n != 0) {
+        *wakeup = POLLING_WAKEUP;
+        return n;
+      }
+      int64_t idle = monotonic_time_us() - start;
+      if (idle < loop->busy_poll / 2) {
+        cpu_relax();
+      } else if (idle < loop->busy_poll) {
+        sched_yield();
+      } else {
+        break;
+      }
+    }
+  }
+  *wakeup = BLOCKING_WAKEUP;
+  return epoll_wait(loop->epoll_fd, events, MAX_EVENTS_PER_READ, -1);
+}
+
+int run_event_loop(int *fds, unsigned int fd_count, configuration_t *config, const char *config_path,
+                   flush_callback_t callback, void *data, const char *record_path) {
+  struct epoll_event epoll_events[MAX_EVENTS_PER_READ];
+  unsigned int i;
+  bool running = true;
+  int exit_code = 1;
+  event_loop_t loop;
+
+  memset(&loop, 0, sizeof(loop));
+  for (i = 0; i < MAX_TOUCH_DEVICES; i++) {
+    loop.devices[i].fd = -1;
+    loop.devices[i].passthrough_fd = -1;
+  }
+  loop.initial_devices = fd_count;
+  // the configuration used by the recognizers, config itself or a reloaded one
+  loop.config = config;
+  loop.record_path = record_path;
+  loop.busy_poll = config->realtime.busy_poll;
+  loop.grab = config->grab;
+  loop.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (loop.epoll_fd < 0) {
+    die("error: epoll_create1");
+  }
+
+  event_source_t signal_source = {
+    .type = SIGNAL_SOURCE,
+    .device = NULL
+  };
+  int signal_fd = create_signal_fd();
+  watch_fd(loop.epoll_fd, signal_fd, &signal_source);
+
+  event_source_t metrics_source = {
+    .type = METRICS_SOURCE,
+    .device = NULL
+  };
+  int metrics_fd = -1;
+  if (config->metrics_socket_path) {
+    metrics_fd = create_metrics_socket(config->metrics_socket_path);
+    if (metrics_fd < 0) {
+      die("error: create_metrics_socket");
+    }
+    watch_fd(loop.epoll_fd, metrics_fd, &metrics_source);
+  }
+
+  event_source_t config_source = {
+    .type = CONFIG_SOURCE,
+    .device = NULL
+  };
+  int config_fd = create_config_watch(config_path);
+  if (config_fd < 0) {
+    fprintf(stderr, "warning: changes of %s can't be watched\n", config_path);
+  } else {
+    watch_fd(loop.epoll_fd, config_fd, &config_source);
+  }
+
+  event_source_t uevent_source = {
+    .type = UEVENT_SOURCE,
+    .device = NULL
+  };
+  int uevent_fd = create_uevent_socket();
+  if (uevent_fd < 0) {
+    fprintf(stderr, "warning: input devices that are plugged in later can't be used\n");
+  } else {
+    watch_fd(loop.epoll_fd, uevent_fd, &uevent_source);
+  }
+
+  loop.emit_buffer = new_emit_buffer(EMIT_BUFFER_CAPACITY, callback, data);
+  if (!loop.emit_buffer) {
+    die("error: new_emit_buffer");
+  }
+
+  for (i = 0; i < fd_count; i++) {
+    if (!attach_device(&loop, fds[i])) {
+      fprintf(stderr, "error: input device %i can't be used for gesture detection\n", i);
+    }
+  }
+
+  // without hotplug the loop ends with the last device
+  while (running && (loop.active_devices > 0 || uevent_fd >= 0)) {
+    wakeup_t wakeup;
+    int n = wait_for_events(&loop, epoll_events, &wakeup);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      die("error: epoll_wait");
+    }
+    for (i = 0; i < (unsigned int) n; i++) {
+      event_source_t *source = epoll_events[i].data.ptr;
+      touch_device_t *device = source->device;
+      if (device && device->fd < 0) {
+        // the device was detached while handling a previous event of this batch
+        continue;
+      }
+      switch (source->type) {
+        case DEVICE_SOURCE:
+          if (!read_device(device, loop.emit_buffer, wakeup)) {
+            park_device(&loop, device);
+          }
+          break;
+        case SCROLL_TIMER_SOURCE:
+          process_scroll_timer(device->state, loop.emit_buffer);
+          flush_emit_buffer(loop.emit_buffer);
+          break;
+        case TAP_TIMER_SOURCE:
+          process_tap_timer(device->state, loop.emit_buffer);
+          flush_emit_buffer(loop.emit_buffer);
+          break;
+        case SIGNAL_SOURCE:
+          running = false;
+          exit_code = 0;
+          break;
+        case METRICS_SOURCE:
+          serve_metrics(metrics_fd);
+          break;
+        case CONFIG_SOURCE:
+          if (is_config_changed(config_fd, config_path)) {
+            configuration_t *new_config = reload_config(config_path, config);
+            if (new_config) {
+              // nothing is processed concurrently, so all recognizers switch between two frames
+              unsigned int j;
+              for (j = 0; j < MAX_TOUCH_DEVICES; j++) {
+                if (loop.devices[j].state) {
+                  set_gesture_config(loop.devices[j].state, new_config);
+                }
+                // e.g. the palm detection needs more axes
+                if (loop.devices[j].fd >= 0 && is_event_mask_allowed(&loop.devices[j])) {
+                  set_event_mask(loop.devices[j].fd, new_config);
+                }
+              }
+              if (loop.config != config) {
+                free_config(loop.config);
+                free(loop.config);
+              }
+              loop.config = new_config;
+            }
+          }
+          break;
+        case UEVENT_SOURCE: {
+          char path[64];
+          int result;
+          while ((result = read_uevent(uevent_fd, path, sizeof(path))) >= 0) {
+            if (result > 0) {
+              process_new_device(&loop, path);
+            }
+          }
+          break;
+        }
+      }
+    }
+  }
+
+  for (i = 0; i < MAX_TOUCH_DEVICES; i++) {
+    if (loop.devices[i].state) {
+      remove_device(&loop, &loop.devices[i]);
+    }
+  }
+  free_emit_buffer(loop.emit_buffer);
+  if (loop.config != config) {
+    free_config(loop.config);
+    free(loop.config);
+  }
+  if (uevent_fd >= 0) {
+    close(uevent_fd);
+  }
+  if (config_fd >= 0) {
+    close(config_fd);
+  }
+  if (metrics_fd >= 0) {
+    close(metrics_fd);
+    unlink(config->metrics_socket_path);
+  }
+  close(signal_fd);
+  close(loop.epoll_fd);
+  return exit_code;
+}
@@ -0,0 +1,45 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2014 Robin Müller.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef EVENT_LOOP_H_
+#define EVENT_LOOP_H_
+
+#include "configuraion.h"
+#include "emit_buffer.h"
+
+/*
+ * Watches all given touch devices with one epoll instance and feeds their events
+ * to a separate recognizer per device. The emitted events of all devices are
+ * passed to the same callback, together with data. If record_path is given, the events read from
+ * the devices are recorded as traces. Changes of the file at config_path are
+ * applied while running, restricted to what config supports. Touch devices
+ * that are plugged in later are attached, disconnected ones are parked until
+ * they come back.
+ * @return 1 if no device is left to read from and none can be plugged in,
+ *         0 after SIGINT or SIGTERM
+ */
+int run_event_loop(int *fds, unsigned int fd_count, configuration_t *config, const char *config_path,
+                   flush_callback_t callback, void *data, const char *record_path);
+
+#endif // EVENT_LOOP_H_
@@ -29,59 +29,185 @@
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
-#include <pthread.h>
+#include <sys/timerfd.h>
 
 #include <linux/input.h>
 
+#include "common.h"
 #include "gesture_detection.h"
+#include "gesture_table.h"
+#include "metrics.h"
+#include "velocity.h"
 
-#define SCROLL_FINGER_COUNT 2
 #define SCROLL_SLOW_DOWN_FACTOR -0.006
-
-#define PI 3.14159265358979323846264338327
-#define PI_1_2 PI / 2
-#define PI_3_2 3 * PI / 2
-
+// how far ahead in milliseconds a swipe is predicted
+#define PREDICTION_HORIZON 100
+// longest touch in milliseconds that is a tap
+#define TAP_TIME 180
+// how long to wait in milliseconds for the second tap of a double tap
+#define DOUBLE_TAP_TIME 250
+// shortest touch in milliseconds that is a tap and hold
+#define HOLD_TIME 500
+// fingers that move further, in percent of the touch device's size, don't tap
+#define TAP_MOVEMENT_PERCENTAGE 3
 
 typedef struct point {
   int x;
   int y;
 } point_t;
 
+/*
+ * State of all multi touch slots of a device, stored per axis. The bitmasks
+ * have one bit per slot.
+ */
 typedef struct mt_slots {
   unsigned int active;
-  point_t points[2];
-  point_t last_points[2];
+  unsigned int count;
+  // slots with a contact (tracking id != -1)
+  uint32_t used;
+  // slots whose position changed in the current frame
+  uint32_t dirty;
+  // contacts that are palms, for the rest of their lifetime
+  uint32_t palms;
+  // contacts that started at the edge of the touch device and didn't leave it yet
+  uint32_t thumbs;
+  // contacts whose first position is still unknown
+  uint32_t fresh;
+  int tracking_ids[MAX_SLOTS];
+  int x[MAX_SLOTS];
+  int y[MAX_SLOTS];
+  int last_x[MAX_SLOTS];
+  int last_y[MAX_SLOTS];
+  // the first position of the contact, -1 if unknown
+  int start_x[MAX_SLOTS];
+  int start_y[MAX_SLOTS];
+  velocity_tracker_t trackers[MAX_SLOTS];
 } mt_slots_t;
 
 typedef struct scroll {
-  struct input_event last_x_abs_event;
-  struct input_event last_y_abs_event;
   double x_velocity;
   double y_velocity;
   double width;
+  // high resolution units that don't add up to a whole notch yet
+  int hi_res_remainder;
 } scroll_t;
 
 typedef struct gesture_start {
   point_t point;
 } gesture_start_t;
 
-typedef struct scroll_thread_params {
+typedef enum tap_phase {
+  TAP_IDLE,
+  // fingers are on the touch device and may still tap
+  TAP_TOUCHING,
+  // a tap was released, a second one would make it a double tap
+  TAP_RELEASED,
+  // the fingers on the touch device moved, held or clicked
+  TAP_CANCELLED
+} tap_phase_t;
+
+typedef struct tap_state {
+  int timer_fd;
+  tap_phase_t phase;
+  // the most fingers of the current touch
+  unsigned int fingers;
+  // fingers of a released tap while the next touch decides if it is a double tap, 0 if none
+  unsigned int pending;
+  // event times in microseconds when the current touch started and the last tap was released
+  int64_t start;
+  int64_t released;
+} tap_state_t;
+
+typedef struct kinetic_scroll {
+  int timer_fd;
+  bool active;
   unsigned int delta;
   int code;
   bool invert;
-  void (*callback)(input_event_array_t*);
-} scroll_thread_params_t;
+  double velocity;
+} kinetic_scroll_t;
+
+// what the actions of the state machine need to know about the current frame
+typedef struct frame {
+  int64_t time;
+  // the distance the center of the fingers moved since the start of the gesture
+  point_t distance;
+  axis_t axis;
+} frame_t;
+
+typedef void (*gesture_action_t)(gesture_state_t *state, const frame_t *frame, emit_buffer_t *emit_buffer);
 
-typedef enum gesture { NO_GESTURE, SCROLL, ZOOM, SWIPE } gesture_t;
+// the actions of a state of the state machine
+typedef struct gesture_actions {
+  // executed once when the state is entered
+  gesture_action_t enter;
+  // executed for every following frame, including the one the state was entered with
+  gesture_action_t frame;
+  // executed when the fingers of the gesture change or are lifted, without a frame
+  gesture_action_t exit;
+} gesture_actions_t;
 
-mt_slots_t mt_slots;
-gesture_start_t gesture_start;
-unsigned int finger_count;
-volatile scroll_t scroll;
-gesture_t current_gesture;
-double last_zoom_distance;
-bool is_click = false;
+// a swipe whose keys were sent before the fingers reached the threshold
+typedef struct prediction {
+  // NONE if there is no prediction for the current gesture
+  direction_t direction;
+  int64_t time;
+} prediction_t;
+
+/*
+ * The state is cache line aligned and grouped by how it's accessed: the state of
+ * the current touch that changes with every frame, the values derived from the
+ * configuration that are only read, and the slots. So the states of recognizers
+ * running in different threads never share a cache line.
+ */
+struct gesture_state {
+  // state of the current touch
+  _Alignas(CACHE_LINE_SIZE) gesture_t current_gesture;
+  // the fingers of the current gesture, 0 if it is finished
+  unsigned int finger_count;
+  // number of fingers reported by the BTN_TOOL_* keys, 0 while clicked
+  unsigned int tool_count;
+  // tool_count without the rejected contacts
+  unsigned int contact_count;
+  // bitmask of the pressed BTN_TOOL_* keys, indexed by their finger count
+  unsigned int tools;
+  // the slots of the first two fingers in the current frame, the scroll and
+  // zoom gestures are based on them
+  unsigned int first_slot;
+  unsigned int second_slot;
+  bool is_click;
+  // the current touch had a finger count of consumed_fingers, until all fingers are lifted
+  bool consumed;
+  // KEY_LEFTCTRL is held for the current zoom gesture
+  bool zoom_session;
+  gesture_start_t gesture_start;
+  scroll_t scroll;
+  double last_zoom_distance;
+  prediction_t prediction;
+
+  // derived from the configuration, only changed by set_gesture_config
+  _Alignas(CACHE_LINE_SIZE) configuration_t *config;
+  point_t thresholds;
+  // distance the fingers need to travel before a swipe is predicted
+  point_t prediction_thresholds;
+  point_t offsets;
+  // width of the edges where thumbs rest, the bottom one is y
+  point_t edges;
+  point_t size;
+  point_t tap_distances;
+  // any tap gesture is bound, otherwise touches are not tracked as taps
+  bool taps_enabled;
+  // bitmask of the finger counts a swipe, scrolling or zooming is bound to
+  unsigned int consumed_fingers;
+  gesture_table_t table;
+
+  _Alignas(CACHE_LINE_SIZE) mt_slots_t mt_slots;
+
+  // only used by the timers and when the device is added
+  _Alignas(CACHE_LINE_SIZE) tap_state_t tap;
+  kinetic_scroll_t kinetic_scroll;
+  device_info_t info;
+};
 
 static int test_grab(int fd) {
   int rc;
@@ -104,109 +230,180 @@ static void reset_point(point_t *p) {
   p->y = -1;
 }
 
-static void init_gesture() {
-  reset_point(&gesture_start.point);
-  current_gesture = NO_GESTURE;
-  reset_point(&mt_slots.points[0]);
-  reset_point(&mt_slots.points[1]);
-  reset_point(&mt_slots.last_points[0]);
-  reset_point(&mt_slots.last_points[1]);
+static void init_gesture(gesture_state_t *state) {
+  mt_slots_t *mt_slots = &state->mt_slots;
+  unsigned int slot;
+  reset_point(&state->gesture_start.point);
+  state->current_gesture = NO_GESTURE;
+  // the positions stay valid as long as the contact exists, only the movement starts again
+  for (slot = 0; slot < mt_slots->count; slot++) {
+    mt_slots->last_x[slot] = -1;
+    mt_slots->last_y[slot] = -1;
+    reset_velocity_tracker(&mt_slots->trackers[slot]);
+  }
+  state->last_zoom_distance = -1;
+  state->scroll.width = 0;
+  state->scroll.hi_res_remainder = 0;
+  state->scroll.x_velocity = 0;
+  state->scroll.y_velocity = 0;
+  state->prediction.direction = NONE;
+}
 
-  if (finger_count == SCROLL_FINGER_COUNT) {
-    last_zoom_distance = -1;
-    scroll.width = 0;
-    scroll.x_velocity = 0;
-    scroll.y_velocity = 0;
+/*
+ * @return number of fingers reported by a BTN_TOOL_* code, 0 for other codes
+ */
+static unsigned int get_tool_finger_count(unsigned int code) {
+  switch (code) {
+    case BTN_TOOL_FINGER:
+      return 1;
+    case BTN_TOOL_DOUBLETAP:
+      return 2;
+    case BTN_TOOL_TRIPLETAP:
+      return 3;
+    case BTN_TOOL_QUADTAP:
+      return 4;
+    case BTN_TOOL_QUINTTAP:
+      return 5;
+    default:
+      return 0;
   }
 }
 
 /*
- * @return number of fingers on touch device
+ * @return the highest finger count of the pressed BTN_TOOL_* keys
  */
-static unsigned int process_key_event(struct input_event event) {
-  unsigned int finger_count;
-  if (event.value == 1 && !is_click) {
-    switch (event.code) {
-      case BTN_TOOL_FINGER:
-        finger_count = 1;
-        break;
-      case BTN_TOOL_DOUBLETAP:
-        finger_count = 2;
-        break;
-      case BTN_TOOL_TRIPLETAP:
-        finger_count = 3;
-        break;
-      case BTN_TOOL_QUADTAP:
-        finger_count = 4;
-        break;
-      case BTN_TOOL_QUINTTAP:
-        finger_count = 5;
-        break;
-      case BTN_LEFT:
-        is_click = true;
-        finger_count = 0;
-        break;
-      default:
-        finger_count = 0;
-    }
-  } else if (event.value == 0) {
-    switch (event.code) {
-      case BTN_TOOL_FINGER:
-        finger_count = 0;
-        break;
-      case BTN_LEFT:
-        is_click = false;
-        break;
+static unsigned int count_fingers(unsigned int tools) {
+  unsigned int count = 0;
+  while (tools >> (count + 1)) {
+    count++;
+  }
+  return count;
+}
+
+/*
+ * Updates tool_count. The pressed BTN_TOOL_* keys are tracked as bitmask, because
+ * the kernel doesn't guarantee the order of release and press within a frame.
+ */
+static void process_key_event(gesture_state_t *state, struct input_event event) {
+  if (event.code == BTN_LEFT) {
+    state->is_click = event.value != 0;
+    // no gestures while the touch device is clicked
+    if (state->is_click) {
+      state->tool_count = 0;
     }
+    return;
+  }
+
+  unsigned int tool_finger_count = get_tool_finger_count(event.code);
+  if (tool_finger_count == 0) {
+    return;
+  }
+  unsigned int last_count = count_fingers(state->tools);
+  if (event.value) {
+    state->tools |= 1 << tool_finger_count;
+  } else {
+    state->tools &= ~(1 << tool_finger_count);
+  }
+  unsigned int count = count_fingers(state->tools);
+  if (count != last_count) {
+    state->tool_count = state->is_click ? 0 : count;
   }
-  return finger_count;
 }
 
 /*
- * @return velocity in distance per milliseconds
+ * @return the slots of the contacts that are fingers
  */
-static double calcualte_velocity(struct input_event event1, struct input_event event2) {
-  int distance = event2.value - event1.value;
-  double time_delta = 
-    event2.time.tv_sec * 1000 + event2.time.tv_usec / 1000 - event1.time.tv_sec * 1000 - event1.time.tv_usec / 1000;
-  return distance / time_delta;
+static uint32_t get_fingers(mt_slots_t *mt_slots) {
+  return mt_slots->used & ~(mt_slots->palms | mt_slots->thumbs);
+}
+
+static bool is_at_edge(gesture_state_t *state, unsigned int slot) {
+  int x = state->mt_slots.x[slot], y = state->mt_slots.y[slot];
+  return x < state->edges.x || x > state->size.x - state->edges.x || y > state->size.y - state->edges.y;
+}
+
+/*
+ * A contact is a thumb if its first position is at the edge, until it leaves the edge.
+ */
+static void check_thumb(gesture_state_t *state, unsigned int slot) {
+  mt_slots_t *mt_slots = &state->mt_slots;
+  uint32_t bit = 1U << slot;
+  if (!((mt_slots->fresh | mt_slots->thumbs) & bit) || mt_slots->x[slot] < 0 || mt_slots->y[slot] < 0) {
+    return;
+  }
+  if (is_at_edge(state, slot)) {
+    mt_slots->thumbs |= mt_slots->fresh & bit;
+  } else {
+    mt_slots->thumbs &= ~bit;
+  }
+  mt_slots->fresh &= ~bit;
 }
 
-static void process_abs_event(struct input_event event, point_t offsets, bool invert_horz_scroll, bool invert_vert_scroll) {
+static void process_abs_event(gesture_state_t *state, struct input_event event) {
+  mt_slots_t *mt_slots = &state->mt_slots;
+  configuration_t *config = state->config;
+  unsigned int slot = mt_slots->active;
   if (event.code == ABS_MT_SLOT) {
     // store the current mt_slot
-    mt_slots.active = event.value;
-  } else if (mt_slots.active < 2) {
+    mt_slots->active = event.value;
+  } else if (slot < mt_slots->count) {
     switch (event.code) {
-      case ABS_MT_POSITION_X:
-        // if finger count matches SCROLL_FINGER_COUNT and the ABS_MT_POSITION_X is for the first finger
-        // the scroll data need to be updated
-        if (mt_slots.active == 0 && finger_count == SCROLL_FINGER_COUNT) {
-          // check wether a correct input event was set to scroll.last_x_abs_event
-          if (scroll.last_x_abs_event.type == EV_ABS && scroll.last_x_abs_event.code == ABS_MT_POSITION_X) {
-            // invert the velocity to scroll to the correct direction as a positive x direction
-            // on the touchpad mean scroll left (negative scroll direction)
-            scroll.x_velocity = calcualte_velocity(scroll.last_x_abs_event, event) * (invert_horz_scroll ? 1 : -1);
+      case ABS_MT_TRACKING_ID:
+        mt_slots->tracking_ids[slot] = event.value;
+        // a new contact, nothing of the previous one is valid anymore
+        mt_slots->palms &= ~(1U << slot);
+        mt_slots->thumbs &= ~(1U << slot);
+        if (event.value < 0) {
+          mt_slots->used &= ~(1U << slot);
+          mt_slots->fresh &= ~(1U << slot);
+        } else {
+          mt_slots->start_x[slot] = -1;
+          mt_slots->start_y[slot] = -1;
+          mt_slots->used |= 1U << slot;
+          if (state->edges.x > 0 || state->edges.y > 0) {
+            mt_slots->fresh |= 1U << slot;
           }
-          scroll.last_x_abs_event = event;
+          mt_slots->x[slot] = -1;
+          mt_slots->y[slot] = -1;
+          mt_slots->last_x[slot] = -1;
+          mt_slots->last_y[slot] = -1;
+          reset_velocity_tracker(&mt_slots->trackers[slot]);
         }
-        mt_slots.last_points[mt_slots.active].x = mt_slots.points[mt_slots.active].x;
+        break;
+      case ABS_MT_POSITION_X:
+        mt_slots->last_x[slot] = mt_slots->x[slot];
         // store the current x position for the current mt_slot
-        mt_slots.points[mt_slots.active].x = event.value - offsets.x;
+        mt_slots->x[slot] = event.value - state->offsets.x;
+        if (mt_slots->start_x[slot] < 0) {
+          mt_slots->start_x[slot] = mt_slots->x[slot];
+        }
+        mt_slots->dirty |= 1U << slot;
+        check_thumb(state, slot);
         break;
       case ABS_MT_POSITION_Y:
-        // if finger count matches SCROLL_FINGER_COUNT and the ABS_MT_POSITION_Y is for the first finger
-        // the scroll data need to be updated
-        if (mt_slots.active == 0 && finger_count == SCROLL_FINGER_COUNT) {
-          // check wether a correct input event was set to scroll.last_y_abs_event
-          if (scroll.last_y_abs_event.type == EV_ABS && scroll.last_y_abs_event.code == ABS_MT_POSITION_Y) {
-            scroll.y_velocity = calcualte_velocity(scroll.last_y_abs_event, event) * (invert_vert_scroll ? -1 : 1);
-          }
-          scroll.last_y_abs_event = event;
-        }
-        mt_slots.last_points[mt_slots.active].y = mt_slots.points[mt_slots.active].y;
+        mt_slots->last_y[slot] = mt_slots->y[slot];
         // store the current y position for the current mt_slot
-        mt_slots.points[mt_slots.active].y = event.value - offsets.y;
+        mt_slots->y[slot] = event.value - state->offsets.y;
+        if (mt_slots->start_y[slot] < 0) {
+          mt_slots->start_y[slot] = mt_slots->y[slot];
+        }
+        mt_slots->dirty |= 1U << slot;
+        check_thumb(state, slot);
+        break;
+      case ABS_MT_TOUCH_MAJOR:
+        if (config->palm.size > 0 && event.value >= config->palm.size) {
+          mt_slots->palms |= 1U << slot;
+        }
+        break;
+      case ABS_MT_PRESSURE:
+        if (config->palm.pressure > 0 && event.value >= config->palm.pressure) {
+          mt_slots->palms |= 1U << slot;
+        }
+        break;
+      case ABS_MT_TOOL_TYPE:
+        if (event.value == MT_TOOL_PALM) {
+          mt_slots->palms |= 1U << slot;
+        }
         break;
     }
   }
@@ -223,39 +420,74 @@ static void set_input_event(struct input_event *input_event, int type, int code,
 #define set_key_event(key_event, code, value) set_input_event(key_event, EV_KEY, code, value)
 #define set_rel_event(rel_event, code, value) set_input_event(rel_event, EV_REL, code, value)
 
-static input_event_array_t *do_scroll(double distance, int delta, int rel_code, bool invert) {
-  input_event_array_t *result = NULL;
+/*
+ * @return the number of "scroll-units" the distance adds up to
+ */
+static int accumulate_scroll(gesture_state_t *state, double distance, int delta, bool invert) {
+  int width = 0;
   // increment the scroll width by the current moved distance
-  scroll.width += distance * (invert ? -1 : 1);
+  state->scroll.width += distance * (invert ? -1 : 1);
   // a scroll width of delta means scroll one "scroll-unit" therefore a scroll event
   // can be first triggered if the absolute value of scroll.width exeeded delta
-  if (fabs(scroll.width) > fabs(delta)) {
-    result = new_input_event_array(2);
-    int width = (int)(scroll.width / delta);
-    set_rel_event(&result->data[0], rel_code, width);
-    set_syn_event(&result->data[1]);
-    scroll.width -= width * delta;
+  if (fabs(state->scroll.width) > fabs(delta)) {
+    width = (int)(state->scroll.width / delta);
+    state->scroll.width -= width * delta;
   }
-  return result;
+  return width;
 }
 
-static input_event_array_t *do_zoom(double distance, int delta) {
-  input_event_array_t *result = NULL;
-  input_event_array_t *tmp = do_scroll(distance, delta, REL_WHEEL, false);
-  if (tmp) {
-    result = new_input_event_array(6);
+/*
+ * Scrolls in 1/HI_RES_UNITS_PER_NOTCH notches, a distance of delta is still one notch.
+ * The normal wheel event is sent along whenever the units add up to whole notches.
+ */
+static void do_hi_res_scroll(gesture_state_t *state, emit_buffer_t *emit_buffer, double distance, int delta,
+                             int rel_code, bool invert) {
+  int units = accumulate_scroll(state, distance * HI_RES_UNITS_PER_NOTCH, delta, invert);
+  if (units != 0) {
+    state->scroll.hi_res_remainder += units;
+    int notches = state->scroll.hi_res_remainder / HI_RES_UNITS_PER_NOTCH;
+    state->scroll.hi_res_remainder -= notches * HI_RES_UNITS_PER_NOTCH;
+    struct input_event *events = reserve_events(emit_buffer, notches != 0 ? 3 : 2);
+    set_rel_event(events, rel_code == REL_WHEEL ? REL_WHEEL_HI_RES : REL_HWHEEL_HI_RES, units);
+    if (notches != 0) {
+      events++;
+      set_rel_event(events, rel_code, notches);
+    }
+    set_syn_event(&events[1]);
+  }
+}
+
+static void do_scroll(gesture_state_t *state, emit_buffer_t *emit_buffer, double distance, int delta, int rel_code, bool invert) {
+  if (state->config->scroll.hi_res) {
+    do_hi_res_scroll(state, emit_buffer, distance, delta, rel_code, invert);
+    return;
+  }
+  int width = accumulate_scroll(state, distance, delta, invert);
+  if (width != 0) {
+    struct input_event *events = reserve_events(emit_buffer, 2);
+    set_rel_event(&events[0], rel_code, width);
+    set_syn_event(&events[1]);
+  }
+}
+
+static void do_zoom(gesture_state_t *state, emit_buffer_t *emit_buffer, double distance, int delta) {
+  if (state->zoom_session) {
+    // CTRL is already pressed, only the wheel events are needed
+    do_scroll(state, emit_buffer, distance, delta, REL_WHEEL, false);
+    return;
+  }
+  int width = accumulate_scroll(state, distance, delta, false);
+  if (width != 0) {
+    struct input_event *events = reserve_events(emit_buffer, 6);
     // press CTRL
-    set_key_event(&result->data[0], KEY_LEFTCTRL, 1);
-    set_syn_event(&result->data[1]);
-    // copy the rel_event retrieve via do_scroll
-    result->data[2] = tmp->data[0];
-    set_syn_event(&result->data[3]);
+    set_key_event(&events[0], KEY_LEFTCTRL, 1);
+    set_syn_event(&events[1]);
+    set_rel_event(&events[2], REL_WHEEL, width);
+    set_syn_event(&events[3]);
     // release CTRL
-    set_key_event(&result->data[4], KEY_LEFTCTRL, 0);
-    set_syn_event(&result->data[5]);
-    free(tmp);
+    set_key_event(&events[4], KEY_LEFTCTRL, 0);
+    set_syn_event(&events[5]);
   }
-  return result;
 }
 
 static point_t create_vector(point_t p1, point_t p2) { 
@@ -266,268 +498,750 @@ static point_t create_vector(point_t p1, point_t p2) {
   return result;
 }
 
-#define determine_gesture(scroll_enabled, vector_direction_difference) \
-  /* if scrolling is enable, the finger_count matches SCROLL_FINGER_COUNT and\
-     the direction of the direction vectors for both fingers is equal the current_gesture\
-     will be SCROLL*/\
-  if (scroll_enabled && finger_count == SCROLL_FINGER_COUNT && \
-      (vector_direction_difference < PI_1_2 || vector_direction_difference > PI_3_2)) { \
-    current_gesture = SCROLL; \
-  /* if no scrolling and zooming is enabled or the finger_count does not match\
-     SCROLL_FINGER_COUNT the current_gesture will be SWIPE*/\
-  } else if (!scroll_enabled || finger_count != SCROLL_FINGER_COUNT) { \
-    current_gesture = SWIPE; \
+/*
+ * Compares the direction vectors of count fingers with the one of the first
+ * finger. The angle between two vectors is below 90 degrees if their dot
+ * product is positive and above if it is negative, so no angles are needed.
+ * The loop has no branches and can be vectorized by the compiler.
+ * @return OPPOSED_MOTION if any finger moves against the first one,
+ *         PARALLEL_MOTION if all move in the same direction
+ */
+static motion_t classify_motion(const int *x, const int *y, unsigned int count) {
+  int64_t min_dot = INT64_MAX;
+  unsigned int i;
+  for (i = 1; i < count; i++) {
+    int64_t dot = (int64_t) x[0] * x[i] + (int64_t) y[0] * y[i];
+    min_dot = dot < min_dot ? dot : min_dot;
   }
+  return min_dot < 0 ? OPPOSED_MOTION : min_dot > 0 ? PARALLEL_MOTION : UNDECIDED_MOTION;
+}
 
-static double get_vector_direction(point_t v) {
-  if (v.x == 0) {
-    if (v.y >= 0) {
-      return 0;
-    } else {
-      return PI;
+static bool is_valid_point(point_t p) {
+  return p.x > -1 && p.y > -1;
+}
+
+static point_t get_point(mt_slots_t *mt_slots, unsigned int slot) {
+  point_t result = {
+    .x = mt_slots->x[slot],
+    .y = mt_slots->y[slot]
+  };
+  return result;
+}
+
+static point_t get_last_point(mt_slots_t *mt_slots, unsigned int slot) {
+  point_t result = {
+    .x = mt_slots->last_x[slot],
+    .y = mt_slots->last_y[slot]
+  };
+  return result;
+}
+
+/*
+ * @return the lowest slot set in the bitmask, which is removed from it
+ */
+static unsigned int pop_slot(uint32_t *slots) {
+  unsigned int slot = __builtin_ctz(*slots);
+  *slots &= *slots - 1;
+  return slot;
+}
+
+/*
+ * @return the center of all fingers on the touch device
+ */
+static point_t get_centroid(mt_slots_t *mt_slots) {
+  uint32_t fingers = get_fingers(mt_slots);
+  int x = 0, y = 0, count = 0;
+  while (fingers) {
+    unsigned int slot = pop_slot(&fingers);
+    if (mt_slots->x[slot] > -1 && mt_slots->y[slot] > -1) {
+      x += mt_slots->x[slot];
+      y += mt_slots->y[slot];
+      count++;
     }
-  } else if (v.y == 0) {
-    if (v.x >= 0) {
-      return PI / 2;
-    } else {
-      return 3 * PI / 2;
+  }
+  point_t result = { .x = -1, .y = -1 };
+  if (count > 0) {
+    result.x = x / count;
+    result.y = y / count;
+  }
+  return result;
+}
+
+/*
+ * @return the direction the finger in the given slot is moving to, estimated
+ *         from its recent positions (distance per second)
+ */
+static point_t get_motion_vector(gesture_state_t *state, unsigned int slot, int64_t now) {
+  mt_slots_t *mt_slots = &state->mt_slots;
+  double x_velocity, y_velocity;
+  point_t result;
+  if (estimate_velocity(&mt_slots->trackers[slot], now, &x_velocity, &y_velocity)) {
+    result.x = (int) lround(x_velocity * 1000);
+    result.y = (int) lround(y_velocity * 1000);
+  } else {
+    // not enough samples, fall back to the last movement
+    result = create_vector(get_point(mt_slots, slot), get_last_point(mt_slots, slot));
+  }
+  if (result.x == 0 && result.y == 0) {
+    // a finger that does not move is treated like one moving down
+    result.y = 1;
+  }
+  return result;
+}
+
+static bool has_moved(mt_slots_t *mt_slots, unsigned int slot) {
+  return is_valid_point(get_last_point(mt_slots, slot)) && is_valid_point(get_point(mt_slots, slot));
+}
+
+/*
+ * Determines first_slot and second_slot.
+ * @return false if the fingers needed for the gesture haven't moved yet
+ */
+static bool check_mt_slots(gesture_state_t *state) {
+  mt_slots_t *mt_slots = &state->mt_slots;
+  uint32_t fingers = get_fingers(mt_slots);
+  if (!fingers) {
+    return false;
+  }
+  state->first_slot = pop_slot(&fingers);
+  bool result = has_moved(mt_slots, state->first_slot);
+  if (result && state->finger_count > 1) {
+    if (!fingers) {
+      return false;
     }
-  } else if (v.x > 0) {
-    if (v.y > 0) {
-      return atan(v.x / v.y);
-    } else {
-      return PI / 2 + atan(-v.y / v.x);
+    state->second_slot = pop_slot(&fingers);
+    result = has_moved(mt_slots, state->second_slot);
+  }
+
+  return result;
+}
+
+static void count_gesture(gesture_state_t *state, const frame_t *frame, emit_buffer_t *emit_buffer) {
+  count_metric(gestures[state->current_gesture][FINGER_TO_INDEX(state->finger_count)], 1);
+}
+
+static void scroll_action(gesture_state_t *state, const frame_t *frame, emit_buffer_t *emit_buffer) {
+  configuration_t *config = state->config;
+  mt_slots_t *mt_slots = &state->mt_slots;
+  unsigned int first = state->first_slot;
+  if (frame->axis == HORIZONTAL_AXIS) {
+    do_scroll(state, emit_buffer, mt_slots->last_x[first] - mt_slots->x[first],
+              config->scroll.horz_delta, REL_HWHEEL, config->scroll.invert_horz);
+  } else {
+    do_scroll(state, emit_buffer, mt_slots->y[first] - mt_slots->last_y[first],
+              config->scroll.vert_delta, REL_WHEEL, config->scroll.invert_vert);
+  }
+}
+
+static void zoom_action(gesture_state_t *state, const frame_t *frame, emit_buffer_t *emit_buffer) {
+  mt_slots_t *mt_slots = &state->mt_slots;
+  double finger_distance = calculate_distance(get_point(mt_slots, state->first_slot),
+                                              get_point(mt_slots, state->second_slot));
+  if (state->last_zoom_distance > -1) {
+    do_zoom(state, emit_buffer, finger_distance - state->last_zoom_distance, state->config->zoom.delta);
+  }
+  state->last_zoom_distance = finger_distance;
+}
+
+static void zoom_enter(gesture_state_t *state, const frame_t *frame, emit_buffer_t *emit_buffer) {
+  count_gesture(state, frame, emit_buffer);
+  if (state->config->zoom.hold_modifier) {
+    struct input_event *events = reserve_events(emit_buffer, 2);
+    set_key_event(&events[0], KEY_LEFTCTRL, 1);
+    set_syn_event(&events[1]);
+    state->zoom_session = true;
+  }
+}
+
+static void zoom_exit(gesture_state_t *state, const frame_t *frame, emit_buffer_t *emit_buffer) {
+  if (state->zoom_session) {
+    struct input_event *events = reserve_events(emit_buffer, 2);
+    set_key_event(&events[0], KEY_LEFTCTRL, 0);
+    set_syn_event(&events[1]);
+    state->zoom_session = false;
+  }
+}
+
+/*
+ * @return the direction the fingers passed the threshold in, NONE if they didn't yet
+ */
+static direction_t get_swipe_direction(const frame_t *frame, point_t thresholds) {
+  if (frame->axis == HORIZONTAL_AXIS) {
+    if (frame->distance.x > thresholds.x) {
+      return LEFT;
+    } else if (frame->distance.x < -thresholds.x) {
+      return RIGHT;
     }
   } else {
-    if (v.y < 0) {
-      return PI + atan(v.x / v.y);
-    } else {
-      return 3 * PI / 2 + atan(v.y / -v.x);
+    if (frame->distance.y > thresholds.y) {
+      return UP;
+    } else if (frame->distance.y < -thresholds.y) {
+      return DOWN;
     }
   }
+  return NONE;
 }
 
-static bool is_valid_point(point_t p) {
-  return p.x > -1 && p.y > -1;
+/*
+ * A swipe is predicted once the fingers travelled far enough to be sure about the
+ * axis and are fast enough to pass the threshold within PREDICTION_HORIZON.
+ * @return the predicted direction or NONE
+ */
+static direction_t predict_swipe_direction(gesture_state_t *state, const frame_t *frame) {
+  bool travelled = frame->axis == HORIZONTAL_AXIS ?
+    abs(frame->distance.x) >= state->prediction_thresholds.x : abs(frame->distance.y) >= state->prediction_thresholds.y;
+  double x_velocity, y_velocity;
+  if (!travelled || !estimate_velocity(&state->mt_slots.trackers[state->first_slot], frame->time,
+                                       &x_velocity, &y_velocity)) {
+    return NONE;
+  }
+  frame_t predicted = *frame;
+  // the distance points back to the start of the gesture
+  predicted.distance.x -= (int) lround(x_velocity * PREDICTION_HORIZON);
+  predicted.distance.y -= (int) lround(y_velocity * PREDICTION_HORIZON);
+  return get_swipe_direction(&predicted, state->thresholds);
 }
 
-static bool check_mt_slots() {
-  bool result = is_valid_point(mt_slots.last_points[0]) && is_valid_point(mt_slots.points[0]);
-  if (result && finger_count > 1) {
-    result = is_valid_point(mt_slots.last_points[1]) && is_valid_point(mt_slots.points[1]);
+/*
+ * Presses and releases the keys of a binding.
+ */
+static void send_keys(const key_template_t *template, emit_buffer_t *emit_buffer) {
+  if (template->length > 0) {
+    memcpy(reserve_events(emit_buffer, template->length), template->events,
+           template->length * sizeof(struct input_event));
   }
+}
 
-  return result;
+static void swipe_action(gesture_state_t *state, const frame_t *frame, emit_buffer_t *emit_buffer) {
+  direction_t direction = get_swipe_direction(frame, state->thresholds);
+  if (state->prediction.direction != NONE) {
+    // the keys were already sent, the gesture only continues to measure the time the prediction saved
+    if (direction == state->prediction.direction) {
+      observe_latency(&metrics.swipe_time_saved, frame->time - state->prediction.time);
+    } else if (direction != NONE) {
+      count_metric(missed_swipe_predictions, 1);
+    }
+    if (direction != NONE) {
+      state->prediction.direction = NONE;
+      state->finger_count = 0;
+    }
+    return;
+  }
+  if (direction == NONE && state->config->prediction_percentage > 0) {
+    direction = predict_swipe_direction(state, frame);
+    state->prediction.direction = direction;
+    state->prediction.time = frame->time;
+  }
+  if (direction != NONE) {
+    send_keys(&state->config->templates[FINGER_TO_INDEX(state->finger_count)][direction], emit_buffer);
+    count_gesture(state, frame, emit_buffer);
+    if (state->prediction.direction == NONE) {
+      state->finger_count = 0;
+    }
+  }
 }
 
-unsigned int syn_counter = 0;
+static void swipe_exit(gesture_state_t *state, const frame_t *frame, emit_buffer_t *emit_buffer) {
+  // the fingers were lifted before they reached the threshold
+  if (state->prediction.direction != NONE) {
+    count_metric(missed_swipe_predictions, 1);
+    state->prediction.direction = NONE;
+  }
+}
 
-static input_event_array_t *process_syn_event(struct input_event event,
-                                              configuration_t config,
-                                              point_t thresholds) {
-  input_event_array_t *result = NULL;
-  if (finger_count > 0 && event.code == SYN_REPORT) {
-    if (!check_mt_slots()) {
-      return new_input_event_array(0);
-    } else if (!is_valid_point(gesture_start.point)) {
-      gesture_start.point = mt_slots.points[0];
-    }
+static bool is_tap_bound(gesture_state_t *state, unsigned int fingers, tap_t tap) {
+  return state->config->bindings[FINGER_TO_INDEX(fingers)][TAP_BINDING(tap)].keys[0] > 0;
+}
 
-    direction_t direction = NONE;
-    double vector_direction_difference;
-    if (current_gesture == NO_GESTURE) {
-      double v1_direction = get_vector_direction(create_vector(mt_slots.last_points[0], mt_slots.points[0]));
-      double v2_direction = get_vector_direction(create_vector(mt_slots.last_points[1], mt_slots.points[1]));
-      vector_direction_difference =  fabs(v1_direction - v2_direction);
-      // if zooming is enable, the finger_count matches SCROLL_FINGER_COUNT and the direction
-      // vectors for both fingers are opposed to each other the current_gesture will be ZOOM
-      if (config.zoom.enabled && finger_count == SCROLL_FINGER_COUNT && 
-          vector_direction_difference > PI_1_2 && vector_direction_difference < PI_3_2) {
-        current_gesture = ZOOM;
-      }
+static void set_tap_timer(gesture_state_t *state, long timeout_ms) {
+  struct itimerspec timer_spec = {
+    .it_interval = { .tv_sec = 0, .tv_nsec = 0 },
+    .it_value = { .tv_sec = timeout_ms / 1000, .tv_nsec = (timeout_ms % 1000) * 1000000 }
+  };
+  timerfd_settime(state->tap.timer_fd, 0, &timer_spec, NULL);
+}
+
+static void send_tap(gesture_state_t *state, unsigned int fingers, tap_t tap, emit_buffer_t *emit_buffer) {
+  if (is_tap_bound(state, fingers, tap)) {
+    send_keys(&state->config->templates[FINGER_TO_INDEX(fingers)][TAP_BINDING(tap)], emit_buffer);
+    count_metric(taps[tap][FINGER_TO_INDEX(fingers)], 1);
+  }
+}
+
+/*
+ * The touch after a released tap didn't become a double tap, so the released
+ * one was a single tap.
+ */
+static void send_pending_tap(gesture_state_t *state, emit_buffer_t *emit_buffer) {
+  if (state->tap.pending > 0) {
+    send_tap(state, state->tap.pending, TAP, emit_buffer);
+    state->tap.pending = 0;
+  }
+}
+
+static void cancel_tap(gesture_state_t *state, emit_buffer_t *emit_buffer) {
+  if (state->tap.phase == TAP_TOUCHING) {
+    set_tap_timer(state, 0);
+    send_pending_tap(state, emit_buffer);
+    state->tap.phase = TAP_CANCELLED;
+  }
+}
+
+/*
+ * Follows the touches for the tap gestures. A tap is sent as soon as it is
+ * released, only if a double tap is bound for its fingers it waits for a
+ * second one. Nothing of it delays the other gestures.
+ */
+static void update_tap(gesture_state_t *state, unsigned int count, int64_t now, emit_buffer_t *emit_buffer) {
+  tap_state_t *tap = &state->tap;
+  if (count > 0) {
+    if (tap->phase == TAP_IDLE || tap->phase == TAP_RELEASED) {
+      tap->pending = tap->phase == TAP_RELEASED ? tap->fingers : 0;
+      tap->phase = TAP_TOUCHING;
+      tap->fingers = 0;
+      tap->start = now;
+      set_tap_timer(state, HOLD_TIME);
+    }
+    if (tap->phase == TAP_TOUCHING && count > tap->fingers) {
+      tap->fingers = count;
     }
+    return;
+  }
 
-    if (current_gesture == ZOOM) {
-      double finger_distance = calculate_distance(mt_slots.points[0], mt_slots.points[1]);
-      if (last_zoom_distance > -1) {
-        result = do_zoom(finger_distance - last_zoom_distance, config.zoom.delta);
-      }
-      last_zoom_distance = finger_distance;
+  if (state->is_click) {
+    cancel_tap(state, emit_buffer);
+  }
+  if (tap->phase != TAP_TOUCHING) {
+    tap->phase = TAP_IDLE;
+    return;
+  }
+  set_tap_timer(state, 0);
+  tap->phase = TAP_IDLE;
+  if (now - tap->start > TAP_TIME * 1000) {
+    send_pending_tap(state, emit_buffer);
+  } else if (tap->pending == tap->fingers) {
+    send_tap(state, tap->fingers, DOUBLE_TAP, emit_buffer);
+    tap->pending = 0;
+  } else {
+    send_pending_tap(state, emit_buffer);
+    if (is_tap_bound(state, tap->fingers, DOUBLE_TAP)) {
+      tap->phase = TAP_RELEASED;
+      tap->released = now;
+      set_tap_timer(state, DOUBLE_TAP_TIME);
     } else {
-      int x_distance, y_distance;
-      x_distance = gesture_start.point.x - mt_slots.points[0].x;
-      y_distance = gesture_start.point.y - mt_slots.points[0].y;
-      if (fabs(x_distance) > fabs(y_distance)) {
-        if (current_gesture == NO_GESTURE) {
-          determine_gesture(config.scroll.horz, vector_direction_difference);
-        }
+      send_tap(state, tap->fingers, TAP, emit_buffer);
+    }
+  }
+}
 
-        if (current_gesture == SWIPE) {
-          if (x_distance > thresholds.x) {
-            direction = LEFT;
-          } else if (x_distance < -thresholds.x) {
-            direction = RIGHT;
-          }
-        } else if (current_gesture == SCROLL) {
-          result = do_scroll(mt_slots.last_points[0].x - mt_slots.points[0].x, config.scroll.horz_delta, REL_HWHEEL, config.scroll.invert_horz);
-        }
-      } else {
-        if (current_gesture == NO_GESTURE) {
-          determine_gesture(config.scroll.vert, vector_direction_difference);
-        }
+/*
+ * The released tap got no second one or the touch became a hold.
+ */
+static void process_tap_timeout(gesture_state_t *state, emit_buffer_t *emit_buffer) {
+  tap_state_t *tap = &state->tap;
+  if (tap->phase == TAP_RELEASED) {
+    send_tap(state, tap->fingers, TAP, emit_buffer);
+    tap->phase = TAP_IDLE;
+  } else if (tap->phase == TAP_TOUCHING) {
+    send_pending_tap(state, emit_buffer);
+    send_tap(state, tap->fingers, TAP_AND_HOLD, emit_buffer);
+    tap->phase = TAP_CANCELLED;
+  }
+}
 
-        if (current_gesture == SWIPE) {
-          if (y_distance > thresholds.y) {
-            direction = UP;
-          } else if (y_distance < -thresholds.y) {
-            direction = DOWN;
-          }
-        } else if (current_gesture == SCROLL) {
-          result = do_scroll(mt_slots.points[0].y - mt_slots.last_points[0].y, config.scroll.vert_delta, REL_WHEEL, config.scroll.invert_vert);
+/*
+ * Processes the tap timeout by the event times if the tap timer wasn't processed
+ * in time, e.g. in a fast replay or when the timer and the device got ready together.
+ */
+static void check_tap_timeout(gesture_state_t *state, int64_t now, emit_buffer_t *emit_buffer) {
+  tap_state_t *tap = &state->tap;
+  if ((tap->phase == TAP_RELEASED && now - tap->released > DOUBLE_TAP_TIME * 1000) ||
+      (tap->phase == TAP_TOUCHING && now - tap->start >= HOLD_TIME * 1000)) {
+    set_tap_timer(state, 0);
+    process_tap_timeout(state, emit_buffer);
+  }
+}
+
+// indexed by the state, swipes are counted when they are triggered
+static const gesture_actions_t gesture_actions[GESTURES_COUNT] = {
+  [NO_GESTURE] = { NULL, NULL, NULL },
+  [SCROLL] = { count_gesture, scroll_action, NULL },
+  [ZOOM] = { zoom_enter, zoom_action, zoom_exit },
+  [SWIPE] = { NULL, swipe_action, swipe_exit }
+};
+
+/*
+ * @return how the fingers of the current gesture move relative to each other
+ */
+static motion_t get_motion(gesture_state_t *state, int64_t now) {
+  mt_slots_t *mt_slots = &state->mt_slots;
+  int motion_x[MAX_FINGERS], motion_y[MAX_FINGERS];
+  unsigned int count = 0;
+  uint32_t fingers = get_fingers(mt_slots);
+  while (fingers && count < state->finger_count && count < MAX_FINGERS) {
+    unsigned int slot = pop_slot(&fingers);
+    if (has_moved(mt_slots, slot)) {
+      point_t v = get_motion_vector(state, slot, now);
+      motion_x[count] = v.x;
+      motion_y[count] = v.y;
+      count++;
+    }
+  }
+  return classify_motion(motion_x, motion_y, count);
+}
+
+static void process_syn_event(gesture_state_t *state, struct input_event event, emit_buffer_t *emit_buffer) {
+  mt_slots_t *mt_slots = &state->mt_slots;
+  point_t *start_point = &state->gesture_start.point;
+  if (state->finger_count > 0 && event.code == SYN_REPORT) {
+    int64_t now = event_time_us(event);
+    // only the fingers that moved within this frame need to be updated
+    uint32_t dirty = mt_slots->dirty & get_fingers(mt_slots);
+    mt_slots->dirty = 0;
+    while (dirty) {
+      unsigned int slot = pop_slot(&dirty);
+      if (is_valid_point(get_point(mt_slots, slot))) {
+        add_velocity_sample(&mt_slots->trackers[slot], now, mt_slots->x[slot], mt_slots->y[slot]);
+        if (state->tap.phase == TAP_TOUCHING &&
+            (abs(mt_slots->x[slot] - mt_slots->start_x[slot]) > state->tap_distances.x ||
+             abs(mt_slots->y[slot] - mt_slots->start_y[slot]) > state->tap_distances.y)) {
+          cancel_tap(state, emit_buffer);
         }
       }
     }
-    if (direction != NONE) {
-      unsigned int i;
-      for (i = MAX_KEYS_PER_GESTURE; i > 0; i--) {
-        int key = config.swipe_keys[FINGER_TO_INDEX(finger_count)][direction].keys[i - 1];
-        if (key > 0) {
-          if (!result) {
-            // i is the number of keys to press
-            // therefore i input_events with value 1 + 1 EV_SYN event and i input_events with value 0 + EV_SYN event are needed
-            result = new_input_event_array((i + 1) * 2);
-            set_syn_event(&result->data[i]);
-            set_syn_event(&result->data[result->length - 1]);
-          }
-          // press event
-          set_key_event(&result->data[i - 1], key, 1);
-          // release event
-          set_key_event(&result->data[result->length / 2 + i - 1], key, 0);
-        }
+
+    if (!check_mt_slots(state)) {
+      return;
+    }
+    // swipes are based on the center of all fingers
+    point_t centroid = get_centroid(mt_slots);
+    if (!is_valid_point(*start_point)) {
+      *start_point = centroid;
+    }
+    frame_t frame = {
+      .time = now,
+      .distance = create_vector(*start_point, centroid)
+    };
+    frame.axis = abs(frame.distance.x) > abs(frame.distance.y) ? HORIZONTAL_AXIS : VERTICAL_AXIS;
+
+    if (state->current_gesture == NO_GESTURE) {
+      unsigned int index = FINGER_TO_INDEX(state->finger_count);
+      motion_t motion = state->table.needs_motion[index] ? get_motion(state, now) : UNDECIDED_MOTION;
+      state->current_gesture = state->table.transitions[index][motion][frame.axis];
+      if (gesture_actions[state->current_gesture].enter) {
+        gesture_actions[state->current_gesture].enter(state, &frame, emit_buffer);
       }
-      finger_count = 0;
+    }
+    if (gesture_actions[state->current_gesture].frame) {
+      gesture_actions[state->current_gesture].frame(state, &frame, emit_buffer);
     }
   }
-  return result ? result : new_input_event_array(0);
 }
 
-static int get_axix_threshold(int fd, int axis, unsigned int percentage) {
-  struct input_absinfo absinfo;
-  if (ioctl(fd, EVIOCGABS(axis), &absinfo) < 0) {
-    return -1;
-  }
+static int get_axix_threshold(struct input_absinfo absinfo, unsigned int percentage) {
   return (absinfo.maximum - absinfo.minimum) * percentage / 100;
 }
 
-static int get_axix_offset(int fd, int axis) {
-  struct input_absinfo absinfo;
-  if (ioctl(fd, EVIOCGABS(axis), &absinfo) < 0) {
-    return -1;
-  }
-  return absinfo.minimum;
+static void set_scroll_timer(gesture_state_t *state, long interval_ns) {
+  struct itimerspec timer_spec = {
+    .it_interval = { .tv_sec = 0, .tv_nsec = interval_ns },
+    .it_value = { .tv_sec = 0, .tv_nsec = interval_ns }
+  };
+  timerfd_settime(state->kinetic_scroll.timer_fd, 0, &timer_spec, NULL);
 }
 
-#define slowdown_scroll(velocity, thread_params) \
-  while (velocity != 0) { \
-    struct timespec tim = { \
-      .tv_sec = 0, \
-      .tv_nsec = 5000000 \
-    };\
-    nanosleep(&tim, NULL); \
-    input_event_array_t *events = do_scroll(velocity * 5, thread_params->delta, thread_params->code, thread_params->invert); \
-    if (events) { \
-      thread_params->callback(events); \
-    } \
-    free(events); \
-    double new_velocity = SCROLL_SLOW_DOWN_FACTOR * 5 + fabs(velocity); \
-    if (new_velocity < 0) { \
-      new_velocity = 0; \
-    } \
-    if (velocity > 0) { \
-      velocity = new_velocity; \
-    } else { \
-      velocity = -new_velocity; \
-    } \
+static void start_kinetic_scroll(gesture_state_t *state, int64_t now) {
+  configuration_t *config = state->config;
+  kinetic_scroll_t *kinetic_scroll = &state->kinetic_scroll;
+  double x_velocity, y_velocity;
+  // the contacts are already released at this point, but the slot of the first finger is still known
+  if (!estimate_velocity(&state->mt_slots.trackers[state->first_slot], now, &x_velocity, &y_velocity) ||
+      (x_velocity == 0 && y_velocity == 0)) {
+    return;
   }
+  // invert the x velocity to scroll to the correct direction as a positive x direction
+  // on the touchpad mean scroll left (negative scroll direction)
+  state->scroll.x_velocity = x_velocity * (config->scroll.invert_horz ? 1 : -1);
+  state->scroll.y_velocity = y_velocity * (config->scroll.invert_vert ? -1 : 1);
 
-static void *scroll_thread_function(void *val) {
-  scroll_thread_params_t *params = ((scroll_thread_params_t*)val);
-  if (params->code == REL_WHEEL) {
-    slowdown_scroll(scroll.y_velocity, params);
-  } else if (params->code == REL_HWHEEL) {
-    slowdown_scroll(scroll.x_velocity, params);
+  if (fabs(state->scroll.x_velocity * config->scroll.horz_delta) > fabs(state->scroll.y_velocity * config->scroll.vert_delta)) {
+    kinetic_scroll->delta = config->scroll.horz_delta;
+    kinetic_scroll->code = REL_HWHEEL;
+    kinetic_scroll->invert = config->scroll.invert_horz;
+    kinetic_scroll->velocity = state->scroll.x_velocity;
+  } else {
+    kinetic_scroll->delta = config->scroll.vert_delta;
+    kinetic_scroll->code = REL_WHEEL;
+    kinetic_scroll->invert = config->scroll.invert_vert;
+    kinetic_scroll->velocity = state->scroll.y_velocity;
   }
-  return NULL;
+  kinetic_scroll->active = true;
+  set_scroll_timer(state, SCROLL_TICK * 1000000L);
 }
 
-int process_events(int fd, configuration_t config, void (*callback)(input_event_array_t*)) {
-  struct input_event ev[64];
-  int i, rd;
-
-  point_t thresholds;
-  thresholds.x = get_axix_threshold(fd, ABS_X, config.horz_threshold_percentage);
-  thresholds.y = get_axix_threshold(fd, ABS_Y, config.vert_threshold_percentage);
+static void stop_kinetic_scroll(gesture_state_t *state) {
+  if (state->kinetic_scroll.active) {
+    state->kinetic_scroll.active = false;
+    // a zero value disarms the timer
+    set_scroll_timer(state, 0);
+  }
+}
 
-  point_t offsets;
-  offsets.x = get_axix_offset(fd, ABS_X);
-  offsets.y = get_axix_offset(fd, ABS_Y);
+int get_scroll_timer_fd(gesture_state_t *state) {
+  return state->kinetic_scroll.timer_fd;
+}
 
-  pthread_t scroll_thread = (pthread_t) NULL;
+bool is_kinetic_scrolling(gesture_state_t *state) {
+  return state->kinetic_scroll.active;
+}
 
-  if (thresholds.x < 0 || thresholds.y < 0) {
+void process_scroll_timer(gesture_state_t *state, emit_buffer_t *emit_buffer) {
+  uint64_t expirations;
+  if (read(state->kinetic_scroll.timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+    // the timer was disarmed after epoll reported it
     return;
   }
+  // catch up with all ticks that expired since the last read
+  process_scroll_ticks(state, emit_buffer, expirations);
+}
+
+void process_scroll_ticks(gesture_state_t *state, emit_buffer_t *emit_buffer, uint64_t expirations) {
+  kinetic_scroll_t *kinetic_scroll = &state->kinetic_scroll;
+  while (expirations > 0 && kinetic_scroll->velocity != 0) {
+    count_metric(kinetic_scroll_ticks, 1);
+    do_scroll(state, emit_buffer, kinetic_scroll->velocity * SCROLL_TICK, kinetic_scroll->delta,
+              kinetic_scroll->code, kinetic_scroll->invert);
+    double new_velocity = SCROLL_SLOW_DOWN_FACTOR * SCROLL_TICK + fabs(kinetic_scroll->velocity);
+    if (new_velocity < 0) {
+      new_velocity = 0;
+    }
+    kinetic_scroll->velocity = kinetic_scroll->velocity > 0 ? new_velocity : -new_velocity;
+    expirations--;
+  }
+  if (kinetic_scroll->velocity == 0) {
+    stop_kinetic_scroll(state);
+  }
+}
+
+int get_tap_timer_fd(gesture_state_t *state) {
+  return state->tap.timer_fd;
+}
 
-  if (test_grab(fd) < 0) {
+void process_tap_timer(gesture_state_t *state, emit_buffer_t *emit_buffer) {
+  tap_state_t *tap = &state->tap;
+  uint64_t expirations;
+  if (read(tap->timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+    // the timer was disarmed after epoll reported it
     return;
   }
+  process_tap_timeout(state, emit_buffer);
+}
 
-  while (1) {
-    rd = read(fd, ev, sizeof(struct input_event) * 64);
+bool is_touch_consumed(gesture_state_t *state) {
+  return state->consumed;
+}
 
-    if (rd < (int) sizeof(struct input_event)) {
-      printf("expected %d bytes, got %d\n", (int) sizeof(struct input_event), rd);
-      return 1;
+bool query_device_info(int fd, device_info_t *info) {
+  if (ioctl(fd, EVIOCGABS(ABS_X), &info->x) < 0 || ioctl(fd, EVIOCGABS(ABS_Y), &info->y) < 0) {
+    return false;
+  }
+  if (ioctl(fd, EVIOCGABS(ABS_MT_SLOT), &info->slot) < 0) {
+    memset(&info->slot, 0, sizeof(info->slot));
+  }
+  return test_grab(fd) == 0;
+}
+
+gesture_state_t *new_gesture_state(const device_info_t *info, configuration_t *config) {
+  gesture_state_t *state = aligned_alloc(CACHE_LINE_SIZE, sizeof(gesture_state_t));
+  if (!state) {
+    return NULL;
+  }
+  memset(state, 0, sizeof(gesture_state_t));
+  state->info = *info;
+  set_gesture_config(state, config);
+
+  state->offsets.x = info->x.minimum;
+  state->offsets.y = info->y.minimum;
+
+  // if the number of slots is unknown all are tracked
+  state->mt_slots.count = info->slot.maximum > 0 && info->slot.maximum < MAX_SLOTS ? info->slot.maximum + 1 : MAX_SLOTS;
+  unsigned int slot;
+  for (slot = 0; slot < state->mt_slots.count; slot++) {
+    state->mt_slots.tracking_ids[slot] = -1;
+    state->mt_slots.x[slot] = -1;
+    state->mt_slots.y[slot] = -1;
+    state->mt_slots.last_x[slot] = -1;
+    state->mt_slots.last_y[slot] = -1;
+    state->mt_slots.start_x[slot] = -1;
+    state->mt_slots.start_y[slot] = -1;
+  }
+
+  state->kinetic_scroll.timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (state->kinetic_scroll.timer_fd < 0) {
+    free(state);
+    return NULL;
+  }
+  state->tap.timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (state->tap.timer_fd < 0) {
+    close(state->kinetic_scroll.timer_fd);
+    free(state);
+    return NULL;
+  }
+  return state;
+}
+
+void set_gesture_config(gesture_state_t *state, configuration_t *config) {
+  state->config = config;
+  compile_gesture_table(config, &state->table);
+  state->thresholds.x = get_axix_threshold(state->info.x, config->horz_threshold_percentage);
+  state->thresholds.y = get_axix_threshold(state->info.y, config->vert_threshold_percentage);
+  state->prediction_thresholds.x = state->thresholds.x * config->prediction_percentage / 100;
+  state->prediction_thresholds.y = state->thresholds.y * config->prediction_percentage / 100;
+  state->size.x = state->info.x.maximum - state->info.x.minimum;
+  state->size.y = state->info.y.maximum - state->info.y.minimum;
+  state->edges.x = get_axix_threshold(state->info.x, config->palm.edge);
+  state->edges.y = get_axix_threshold(state->info.y, config->palm.edge);
+  state->tap_distances.x = get_axix_threshold(state->info.x, TAP_MOVEMENT_PERCENTAGE);
+  state->tap_distances.y = get_axix_threshold(state->info.y, TAP_MOVEMENT_PERCENTAGE);
+  state->taps_enabled = false;
+  unsigned int fingers, tap;
+  for (fingers = 1; fingers <= MAX_FINGERS; fingers++) {
+    for (tap = 0; tap < TAPS_COUNT; tap++) {
+      state->taps_enabled = state->taps_enabled || is_tap_bound(state, fingers, tap);
+    }
+  }
+  state->consumed_fingers = 0;
+  for (fingers = 1; fingers <= MAX_FINGERS; fingers++) {
+    unsigned int direction;
+    // taps and holds don't move the pointer, so their touches aren't consumed
+    for (direction = 0; direction < DIRECTIONS_COUNT; direction++) {
+      if (config->bindings[FINGER_TO_INDEX(fingers)][direction].keys[0] > 0) {
+        state->consumed_fingers |= 1U << fingers;
+      }
     }
+  }
+  if (config->scroll.vert || config->scroll.horz) {
+    state->consumed_fingers |= 1U << config->scroll.fingers;
+  }
+  if (config->zoom.enabled) {
+    state->consumed_fingers |= 1U << config->zoom.fingers;
+  }
+}
 
-    for (i = 0; i < rd / sizeof(struct input_event); i++) {
-      switch(ev[i].type) {
-        case EV_KEY:
-          finger_count = process_key_event(ev[i]);
-          if (finger_count > 0) {
-            if (scroll_thread) {
-              pthread_cancel(scroll_thread);
-            }
-            init_gesture();
-          } else if (current_gesture == SCROLL && (scroll.x_velocity != 0 || scroll.y_velocity != 0)) {
-            scroll_thread_params_t params = {
-              .callback = callback
-            };
-            if (fabs(scroll.x_velocity * config.scroll.horz_delta) > fabs(scroll.y_velocity * config.scroll.vert_delta)) {
-              params.delta = config.scroll.horz_delta;
-              params.code = REL_HWHEEL;
-              params.invert = config.scroll.invert_horz;
-              scroll.y_velocity = 0;
-            } else {
-              params.delta = config.scroll.vert_delta;
-              params.code = REL_WHEEL;
-              params.invert = config.scroll.invert_vert;
-              scroll.x_velocity = 0;
-            }
-            pthread_create(&scroll_thread, NULL, &scroll_thread_function, (void*) &params);
-          }
-          break;
-        case EV_ABS:
-            process_abs_event(ev[i], offsets, config.scroll.invert_horz, config.scroll.invert_vert);
-          break;
-        case EV_SYN: {
-            input_event_array_t *input_events = process_syn_event(ev[i], config, thresholds);
-            callback(input_events);
-            free(input_events);
-          }
-          break;
+void free_gesture_state(gesture_state_t *state) {
+  close(state->kinetic_scroll.timer_fd);
+  close(state->tap.timer_fd);
+  free(state);
+}
+
+void end_gesture(gesture_state_t *state, emit_buffer_t *emit_buffer) {
+  if (gesture_actions[state->current_gesture].exit) {
+    gesture_actions[state->current_gesture].exit(state, NULL, emit_buffer);
+  }
+}
+
+void park_gesture_state(gesture_state_t *state, emit_buffer_t *emit_buffer) {
+  end_gesture(state, emit_buffer);
+  stop_kinetic_scroll(state);
+  state->current_gesture = NO_GESTURE;
+  state->finger_count = 0;
+  state->tool_count = 0;
+  state->contact_count = 0;
+  state->tools = 0;
+  state->is_click = false;
+  state->consumed = false;
+  state->mt_slots.active = 0;
+  state->mt_slots.used = 0;
+  state->mt_slots.dirty = 0;
+  state->mt_slots.palms = 0;
+  state->mt_slots.thumbs = 0;
+  state->mt_slots.fresh = 0;
+  // the timer isn't watched while the device is detached, a released tap is sent right away
+  set_tap_timer(state, 0);
+  if (state->tap.phase == TAP_RELEASED) {
+    send_tap(state, state->tap.fingers, TAP, emit_buffer);
+  }
+  send_pending_tap(state, emit_buffer);
+  state->tap.phase = TAP_IDLE;
+}
+
+/*
+ * Starts a new gesture if the number of fingers changed within the frame, rejected
+ * contacts don't count. Done once per frame, because the BTN_TOOL_* keys and the
+ * contacts that turn out to be palms change at different events of it.
+ */
+static void update_finger_count(gesture_state_t *state, int64_t now, emit_buffer_t *emit_buffer) {
+  mt_slots_t *mt_slots = &state->mt_slots;
+  unsigned int rejected = __builtin_popcount(mt_slots->used & (mt_slots->palms | mt_slots->thumbs));
+  unsigned int count = state->tool_count > rejected ? state->tool_count - rejected : 0;
+  check_tap_timeout(state, now, emit_buffer);
+  if (count == state->contact_count) {
+    return;
+  }
+  state->contact_count = count;
+  if (count == 0) {
+    state->consumed = false;
+  } else if (state->consumed_fingers & (1U << count)) {
+    state->consumed = true;
+  }
+  // still followed after the taps were unbound, until the current touch is resolved
+  if (state->taps_enabled || state->tap.phase != TAP_IDLE) {
+    update_tap(state, count, now, emit_buffer);
+  }
+  end_gesture(state, emit_buffer);
+  state->finger_count = count;
+  if (count > 0) {
+    stop_kinetic_scroll(state);
+    init_gesture(state);
+  } else if (state->current_gesture == SCROLL) {
+    start_kinetic_scroll(state, now);
+  }
+}
+
+bool is_event_used(const configuration_t *config, unsigned int type, unsigned int code) {
+  switch (type) {
+    case EV_KEY:
+      return code == BTN_LEFT || get_tool_finger_count(code) > 0;
+    case EV_ABS:
+      switch (code) {
+        case ABS_MT_SLOT:
+        case ABS_MT_TRACKING_ID:
+        case ABS_MT_POSITION_X:
+        case ABS_MT_POSITION_Y:
+        case ABS_MT_TOOL_TYPE:
+          return true;
+        // only needed for the palm detection
+        case ABS_MT_TOUCH_MAJOR:
+          return config->palm.size > 0;
+        case ABS_MT_PRESSURE:
+          return config->palm.pressure > 0;
       }
+      return false;
+    case EV_SYN:
+      // the kernel doesn't filter them by code
+      return true;
+  }
+  return false;
+}
+
+void process_events(gesture_state_t *state, struct input_event *events, size_t count, emit_buffer_t *emit_buffer) {
+  size_t i;
+
+  for (i = 0; i < count; i++) {
+    switch(events[i].type) {
+      case EV_KEY:
+        process_key_event(state, events[i]);
+        break;
+      case EV_ABS:
+        process_abs_event(state, events[i]);
+        break;
+      case EV_SYN:
+        if (events[i].code == SYN_REPORT) {
+          count_metric(frames, 1);
+          update_finger_count(state, event_time_us(events[i]), emit_buffer);
+        }
+        process_syn_event(state, events[i], emit_buffer);
+        break;
     }
   }
-  return 0;
 }
@@ -26,8 +26,91 @@
 #define GESTURE_DETECTION_H_
 
 #include "configuraion.h"
+#include "emit_buffer.h"
 #include "input_event_array.h"
 
-int process_events(int fd, configuration_t config, void (*callback)(input_event_array_t*));
+#include <stdbool.h>
+
+#include <linux/input.h>
+
+// multi touch slots that are tracked at most, must not exceed the bits of the slot bitmasks
+#define MAX_SLOTS 32
+// interval of the kinetic scroll timer in milliseconds
+#define SCROLL_TICK 5
+
+typedef enum gesture { NO_GESTURE, SCROLL, ZOOM, SWIPE, GESTURES_COUNT } gesture_t;
+
+typedef struct gesture_state gesture_state_t;
+
+/*
+ * The properties of a touch device the recognizer depends on.
+ */
+typedef struct device_info {
+  struct input_absinfo x;
+  struct input_absinfo y;
+  // ABS_MT_SLOT, all zero if unknown
+  struct input_absinfo slot;
+} device_info_t;
+
+/*
+ * @return false if the device's axes can't be queried or the device is grabbed
+ */
+bool query_device_info(int fd, device_info_t *info);
+/*
+ * Creates the recognizer state for a touch device. Every device has its own
+ * state, the configuration may be shared between them.
+ */
+gesture_state_t *new_gesture_state(const device_info_t *info, configuration_t *config);
+/*
+ * Replaces the configuration of the state between two frames, a gesture in
+ * progress continues with it.
+ */
+void set_gesture_config(gesture_state_t *state, configuration_t *config);
+void free_gesture_state(gesture_state_t *state);
+/*
+ * Feeds the events to the recognizer. The resulting events are appended to the
+ * emit_buffer, flushing it is up to the caller.
+ */
+void process_events(gesture_state_t *state, struct input_event *events, size_t count, emit_buffer_t *emit_buffer);
+/*
+ * @return true if process_events uses the events with the given type and code
+ *         with the configuration, the others can be left out. All EV_SYN
+ *         events count as used.
+ */
+bool is_event_used(const configuration_t *config, unsigned int type, unsigned int code);
+/*
+ * Ends the current gesture, keys held by it are released into the emit_buffer.
+ * Has to be called before a state is freed while its device is still in use.
+ */
+void end_gesture(gesture_state_t *state, emit_buffer_t *emit_buffer);
+/*
+ * Ends the current gesture and forgets all contacts, for a device that is
+ * disconnected. The state can be used again when it is reconnected.
+ */
+void park_gesture_state(gesture_state_t *state, emit_buffer_t *emit_buffer);
+/*
+ * @return true from the first frame of the current touch that had the finger
+ *         count of a configured swipe, scrolling or zooming until all of its
+ *         fingers are lifted
+ */
+bool is_touch_consumed(gesture_state_t *state);
+/*
+ * The returned timerfd becomes readable while the state scrolls kinetically,
+ * process_scroll_timer has to be called then.
+ */
+int get_scroll_timer_fd(gesture_state_t *state);
+void process_scroll_timer(gesture_state_t *state, emit_buffer_t *emit_buffer);
+bool is_kinetic_scrolling(gesture_state_t *state);
+/*
+ * Runs the given number of kinetic scroll ticks without the timer, e.g. by the
+ * event times of a replayed trace.
+ */
+void process_scroll_ticks(gesture_state_t *state, emit_buffer_t *emit_buffer, uint64_t ticks);
+/*
+ * The returned timerfd becomes readable when a tap gesture times out,
+ * process_tap_timer has to be called then.
+ */
+int get_tap_timer_fd(gesture_state_t *state);
+void process_tap_timer(gesture_state_t *state, emit_buffer_t *emit_buffer);
 
 #endif // GESTURE_DETECTION_H_
@@ -0,0 +1,86 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2014 Robin Müller.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdlib.h>
+
+#include "common.h"
+#include "gesture_recognizer.h"
+
+// the most events a single feed or timer call emits before they are passed on
+#define EMIT_BUFFER_CAPACITY 256
+
+struct gesture_recognizer {
+  _Alignas(CACHE_LINE_SIZE) gesture_state_t *state;
+  emit_buffer_t *emit_buffer;
+};
+
+gesture_recognizer_t *create_gesture_recognizer(const device_info_t *info, configuration_t *config,
+                                                flush_callback_t output, void *data) {
+  gesture_recognizer_t *recognizer = aligned_alloc(CACHE_LINE_SIZE, sizeof(gesture_recognizer_t));
+  if (!recognizer) {
+    return NULL;
+  }
+  recognizer->state = new_gesture_state(info, config);
+  recognizer->emit_buffer = new_emit_buffer(EMIT_BUFFER_CAPACITY, output, data);
+  if (!recognizer->state || !recognizer->emit_buffer) {
+    if (recognizer->state) {
+      free_gesture_state(recognizer->state);
+    }
+    if (recognizer->emit_buffer) {
+      free_emit_buffer(recognizer->emit_buffer);
+    }
+    free(recognizer);
+    return NULL;
+  }
+  return recognizer;
+}
+
+void destroy_gesture_recognizer(gesture_recognizer_t *recognizer) {
+  end_gesture(recognizer->state, recognizer->emit_buffer);
+  flush_emit_buffer(recognizer->emit_buffer);
+  free_emit_buffer(recognizer->emit_buffer);
+  free_gesture_state(recognizer->state);
+  free(recognizer);
+}
+
+void set_gesture_recognizer_config(gesture_recognizer_t *recognizer, configuration_t *config) {
+  set_gesture_config(recognizer->state, config);
+}
+
+void feed_gesture_recognizer(gesture_recognizer_t *recognizer, struct input_event *events, size_t count) {
+  process_events(recognizer->state, events, count, recognizer->emit_buffer);
+  flush_emit_buffer(recognizer->emit_buffer);
+}
+
+void get_gesture_recognizer_timer_fds(gesture_recognizer_t *recognizer, int fds[2]) {
+  fds[0] = get_scroll_timer_fd(recognizer->state);
+  fds[1] = get_tap_timer_fd(recognizer->state);
+}
+
+void process_gesture_recognizer_timers(gesture_recognizer_t *recognizer) {
+  // both return at once if their timer didn't expire
+  process_scroll_timer(recognizer->state, recognizer->emit_buffer);
+  process_tap_timer(recognizer->state, recognizer->emit_buffer);
+  flush_emit_buffer(recognizer->emit_buffer);
+}
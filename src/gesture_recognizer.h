@@ -0,0 +1,68 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2014 Robin Müller.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef GESTURE_RECOGNIZER_H_
+#define GESTURE_RECOGNIZER_H_
+
+#include <stddef.h>
+
+#include "configuraion.h"
+#include "emit_buffer.h"
+#include "gesture_detection.h"
+
+/*
+ * Everything needed to recognize the gestures of one touch device, for programs
+ * that embed the recognizer (libtouch_gestures.a). Recognizers share no state
+ * apart from the metrics, which are updated atomically, so several of them can
+ * be fed from different threads at once. A single recognizer must only be used
+ * by one thread at a time.
+ */
+typedef struct gesture_recognizer gesture_recognizer_t;
+
+/*
+ * The configuration must stay valid until the recognizer is destroyed or gets
+ * another one. The events emitted by a call are passed to output at once.
+ * @return NULL on error
+ */
+gesture_recognizer_t *create_gesture_recognizer(const device_info_t *info, configuration_t *config,
+                                                flush_callback_t output, void *data);
+/*
+ * Ends the current gesture and frees the recognizer, held keys are released
+ * to output before.
+ */
+void destroy_gesture_recognizer(gesture_recognizer_t *recognizer);
+void set_gesture_recognizer_config(gesture_recognizer_t *recognizer, configuration_t *config);
+/*
+ * Feeds events read from the touch device to the recognizer, incomplete frames
+ * are continued by the next call.
+ */
+void feed_gesture_recognizer(gesture_recognizer_t *recognizer, struct input_event *events, size_t count);
+/*
+ * Stores the timerfds of the recognizer in fds, process_gesture_recognizer_timers
+ * has to be called when one of them becomes readable.
+ */
+void get_gesture_recognizer_timer_fds(gesture_recognizer_t *recognizer, int fds[2]);
+void process_gesture_recognizer_timers(gesture_recognizer_t *recognizer);
+
+#endif // GESTURE_RECOGNIZER_H_
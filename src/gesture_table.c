@@ -0,0 +1,57 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2014 Robin Müller.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "gesture_table.h"
+
+static gesture_t get_transition(const configuration_t *config, unsigned int finger_count, motion_t motion,
+                                axis_t axis) {
+  bool scroll_enabled = axis == HORIZONTAL_AXIS ? config->scroll.horz : config->scroll.vert;
+  bool scroll_fingers = scroll_enabled && finger_count == config->scroll.fingers;
+  // fingers moving against each other zoom
+  if (config->zoom.enabled && finger_count == config->zoom.fingers && motion == OPPOSED_MOTION) {
+    return ZOOM;
+  }
+  // fingers moving in the same direction scroll
+  if (scroll_fingers && motion == PARALLEL_MOTION) {
+    return SCROLL;
+  }
+  // every other finger count swipes, the scroll finger count waits until the motion is clear
+  return scroll_fingers ? NO_GESTURE : SWIPE;
+}
+
+void compile_gesture_table(const configuration_t *config, gesture_table_t *table) {
+  unsigned int i, axis;
+  motion_t motion;
+  for (i = 0; i < MAX_FINGERS; i++) {
+    table->needs_motion[i] = false;
+    for (motion = UNDECIDED_MOTION; motion < MOTIONS_COUNT; motion++) {
+      for (axis = 0; axis < AXES_COUNT; axis++) {
+        table->transitions[i][motion][axis] = get_transition(config, INDEX_TO_FINGER(i), motion, axis);
+        if (table->transitions[i][motion][axis] != table->transitions[i][UNDECIDED_MOTION][axis]) {
+          table->needs_motion[i] = true;
+        }
+      }
+    }
+  }
+}
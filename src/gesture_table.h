@@ -0,0 +1,63 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2014 Robin Müller.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef GESTURE_TABLE_H_
+#define GESTURE_TABLE_H_
+
+#include <stdbool.h>
+
+#include "configuraion.h"
+#include "gesture_detection.h"
+
+// how the direction vectors of several fingers relate to each other
+typedef enum motion {
+  UNDECIDED_MOTION,
+  PARALLEL_MOTION,
+  OPPOSED_MOTION,
+  MOTIONS_COUNT
+} motion_t;
+
+// the axis the fingers moved farther along since the gesture started
+typedef enum axis {
+  HORIZONTAL_AXIS,
+  VERTICAL_AXIS,
+  AXES_COUNT
+} axis_t;
+
+/*
+ * The transitions out of NO_GESTURE, compiled from the configuration. A frame
+ * is looked up by its finger count, the motion of the fingers and the axis,
+ * which are the guards of the state machine. A NO_GESTURE entry keeps waiting
+ * for more frames.
+ */
+typedef struct gesture_table {
+  gesture_t transitions[MAX_FINGERS][MOTIONS_COUNT][AXES_COUNT];
+  // false if the motion doesn't make a difference for the finger count, then
+  // it doesn't need to be estimated
+  bool needs_motion[MAX_FINGERS];
+} gesture_table_t;
+
+void compile_gesture_table(const configuration_t *config, gesture_table_t *table);
+
+#endif // GESTURE_TABLE_H_
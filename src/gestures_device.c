@@ -33,9 +33,11 @@
 #include <linux/uinput.h>
 
 #include "common.h"
+#include "gesture_detection.h"
 #include "gestures_device.h"
+#include "metrics.h"
 
-int init_uinput(int_array_t *keys) {
+int init_uinput(int_array_t *keys, bool hi_res_wheel) {
   int fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
   if(fd < 0) {
       die("error: open");
@@ -47,6 +49,10 @@ int init_uinput(int_array_t *keys) {
   
   ioctl(fd, UI_SET_RELBIT, REL_WHEEL);
   ioctl(fd, UI_SET_RELBIT, REL_HWHEEL);
+  if (hi_res_wheel) {
+    ioctl(fd, UI_SET_RELBIT, REL_WHEEL_HI_RES);
+    ioctl(fd, UI_SET_RELBIT, REL_HWHEEL_HI_RES);
+  }
 
   int i;
   for (i = 0; i < keys->length; i++) {
@@ -72,6 +78,84 @@ int init_uinput(int_array_t *keys) {
   return fd;
 }
 
+/*
+ * Sets the bits of the given type the touch device supports.
+ * @return false if the touch device can't be queried
+ */
+static bool copy_bits(int touch_fd, int fd, int type, int max, unsigned long request) {
+  unsigned long bits[NBITS(KEY_MAX)];
+  int code;
+  memset(bits, 0, sizeof(bits));
+  if (ioctl(touch_fd, EVIOCGBIT(type, max), bits) < 0) {
+    return false;
+  }
+  for (code = 0; code < max; code++) {
+    if (test_bit(code, bits)) {
+      ioctl(fd, request, code);
+    }
+  }
+  return true;
+}
+
+int init_passthrough_uinput(int touch_fd) {
+  unsigned long bits[NBITS(KEY_MAX)];
+  struct uinput_setup setup;
+  char name[UINPUT_MAX_NAME_SIZE] = "touchpad";
+  int code;
+
+  int fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0) {
+    return -1;
+  }
+  memset(bits, 0, sizeof(bits));
+  if (ioctl(touch_fd, EVIOCGBIT(0, EV_MAX), bits) < 0) {
+    close(fd);
+    return -1;
+  }
+  for (code = 0; code < EV_MAX; code++) {
+    if (test_bit(code, bits)) {
+      ioctl(fd, UI_SET_EVBIT, code);
+    }
+  }
+  if (!copy_bits(touch_fd, fd, EV_KEY, KEY_MAX, UI_SET_KEYBIT) ||
+      !copy_bits(touch_fd, fd, EV_MSC, MSC_MAX, UI_SET_MSCBIT)) {
+    close(fd);
+    return -1;
+  }
+
+  // the axes need their ranges and resolutions, libinput relies on them for touchpads
+  memset(bits, 0, sizeof(bits));
+  ioctl(touch_fd, EVIOCGBIT(EV_ABS, ABS_MAX), bits);
+  for (code = 0; code < ABS_MAX; code++) {
+    struct uinput_abs_setup abs_setup;
+    memset(&abs_setup, 0, sizeof(abs_setup));
+    abs_setup.code = code;
+    if (test_bit(code, bits) && ioctl(touch_fd, EVIOCGABS(code), &abs_setup.absinfo) == 0) {
+      ioctl(fd, UI_SET_ABSBIT, code);
+      ioctl(fd, UI_ABS_SETUP, &abs_setup);
+    }
+  }
+  memset(bits, 0, sizeof(bits));
+  ioctl(touch_fd, EVIOCGPROP(sizeof(bits)), bits);
+  for (code = 0; code < INPUT_PROP_MAX; code++) {
+    if (test_bit(code, bits)) {
+      ioctl(fd, UI_SET_PROPBIT, code);
+    }
+  }
+
+  memset(&setup, 0, sizeof(setup));
+  ioctl(touch_fd, EVIOCGNAME(sizeof(name)), name);
+  snprintf(setup.name, UINPUT_MAX_NAME_SIZE, "%.*s%s", (int) (UINPUT_MAX_NAME_SIZE - sizeof(PASSTHROUGH_SUFFIX)), name,
+           PASSTHROUGH_SUFFIX);
+  // the same id, so the device specific settings of the touch device apply to it as well
+  ioctl(touch_fd, EVIOCGID, &setup.id);
+  if (ioctl(fd, UI_DEV_SETUP, &setup) < 0 || ioctl(fd, UI_DEV_CREATE) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
 int destroy_uinput(int fd) {
   if (ioctl(fd, UI_DEV_DESTROY) < 0) {
     die("error: ioctl");
@@ -80,13 +164,89 @@ int destroy_uinput(int fd) {
   close(fd);
 }
 
-void send_events(int fd, input_event_array_t *input_events) {
-  unsigned int i;
-  if (input_events->length > 0) {
-    for (i = 0; i < input_events->length; i++) {
-      if (write(fd, &input_events->data[i], sizeof(struct input_event)) < 0) {
-        die("error: write");
+void set_event_mask(int touch_fd, const configuration_t *config) {
+#ifdef EVIOCSMASK
+  // the types a touch device may have, the masks of the other types are not supported by the kernel
+  static const unsigned int types[] = { EV_KEY, EV_REL, EV_ABS, EV_MSC, EV_SW };
+  unsigned long bits[NBITS(KEY_CNT)];
+  // the mask of EV_SYN selects the types instead of the codes
+  unsigned long type_bits[NBITS(EV_CNT)];
+  unsigned int i, code;
+  memset(type_bits, 0, sizeof(type_bits));
+  type_bits[LONG(EV_SYN)] |= BIT(EV_SYN);
+  for (i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+    memset(bits, 0, sizeof(bits));
+    for (code = 0; code < KEY_CNT; code++) {
+      if (is_event_used(config, types[i], code)) {
+        bits[LONG(code)] |= BIT(code);
+        type_bits[LONG(types[i])] |= BIT(types[i]);
       }
     }
+    struct input_mask mask = {
+      .type = types[i],
+      .codes_size = sizeof(bits),
+      .codes_ptr = (uintptr_t) bits
+    };
+    // older kernels just deliver all events
+    if (ioctl(touch_fd, EVIOCSMASK, &mask) < 0) {
+      return;
+    }
+  }
+  struct input_mask mask = {
+    .type = EV_SYN,
+    .codes_size = sizeof(type_bits),
+    .codes_ptr = (uintptr_t) type_bits
+  };
+  ioctl(touch_fd, EVIOCSMASK, &mask);
+#endif
+}
+
+void write_events(int fd, const struct input_event *events, size_t count) {
+  if (count > 0) {
+    // uinput accepts any number of events per write, so one syscall is enough
+    if (write(fd, events, count * sizeof(struct input_event)) < 0) {
+      die("error: write");
+    }
+    count_metric(writes, 1);
+    count_metric(emitted_events, count);
+  }
+}
+
+void send_events(int fd, input_event_array_t *input_events) {
+  write_events(fd, input_events->data, input_events->length);
+}
+
+void forward_events(int fd, const struct input_event *events, size_t count) {
+  // a lost frame only disturbs the pointer, it's not worth to stop for
+  if (count > 0 && write(fd, events, count * sizeof(struct input_event)) > 0) {
+    count_metric(forwarded_events, count);
+  }
+}
+
+void release_passthrough_contacts(int fd, unsigned int slots, int active_slot) {
+  static const int tools[] = {
+    BTN_TOUCH, BTN_TOOL_FINGER, BTN_TOOL_DOUBLETAP, BTN_TOOL_TRIPLETAP, BTN_TOOL_QUADTAP, BTN_TOOL_QUINTTAP
+  };
+  const unsigned int tools_count = sizeof(tools) / sizeof(tools[0]);
+  struct input_event events[MAX_SLOTS * 2 + sizeof(tools) / sizeof(tools[0]) + 2];
+  unsigned int i, count = 0;
+  memset(events, 0, sizeof(events));
+  for (i = 0; i < slots && i < MAX_SLOTS; i++) {
+    events[count].type = EV_ABS;
+    events[count].code = ABS_MT_SLOT;
+    events[count++].value = i;
+    events[count].type = EV_ABS;
+    events[count].code = ABS_MT_TRACKING_ID;
+    events[count++].value = -1;
+  }
+  events[count].type = EV_ABS;
+  events[count].code = ABS_MT_SLOT;
+  events[count++].value = active_slot;
+  for (i = 0; i < tools_count; i++) {
+    events[count].type = EV_KEY;
+    events[count++].code = tools[i];
   }
+  events[count].type = EV_SYN;
+  events[count++].code = SYN_REPORT;
+  forward_events(fd, events, count);
 }
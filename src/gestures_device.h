@@ -25,11 +25,43 @@
 #ifndef GESTURES_DEVICE_H_
 #define GESTURES_DEVICE_H_
 
+#include <stdbool.h>
+
+#include "configuraion.h"
 #include "int_array.h"
 #include "input_event_array.h"
 
-int init_uinput(int_array_t *keys);
+// appended to the name of the touch device for its passthrough device
+#define PASSTHROUGH_SUFFIX " (passthrough)"
+
+/*
+ * Creates the uinput device, it supports the given keys and the wheel axes.
+ * With hi_res_wheel the high resolution wheel axes are supported as well.
+ */
+int init_uinput(int_array_t *keys, bool hi_res_wheel);
+/*
+ * Creates a uinput device with the name, id, properties and axes of the given
+ * touch device, to pass the events of the grabbed touch device on.
+ * @return the uinput fd or -1 on error
+ */
+int init_passthrough_uinput(int touch_fd);
 int destroy_uinput(int fd);
+/*
+ * Lets the kernel deliver only the events of the touch device that the gesture
+ * detection uses with the configuration. Kernels without EVIOCSMASK deliver all.
+ */
+void set_event_mask(int touch_fd, const configuration_t *config);
+
+void write_events(int fd, const struct input_event *events, size_t count);
 void send_events(int fd, input_event_array_t *input_events);
+/*
+ * Writes events read from a touch device to its passthrough device.
+ */
+void forward_events(int fd, const struct input_event *events, size_t count);
+/*
+ * Lifts all contacts of a passthrough device with slots multi touch slots.
+ * active_slot is selected again afterwards, as the touch device won't repeat it.
+ */
+void release_passthrough_contacts(int fd, unsigned int slots, int active_slot);
 
 #endif // GESTURES_DEVICE_H_
@@ -0,0 +1,269 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2014 Robin Müller.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include <linux/input.h>
+#include <linux/netlink.h>
+
+#include "common.h"
+#include "gestures_device.h"
+#include "hotplug.h"
+
+#define DEV_INPUT_EVENT "/dev/input"
+#define EVENT_DEV_NAME "event"
+// uevents of input devices are small, larger ones are truncated and ignored
+#define UEVENT_BUFFER_SIZE 8192
+// the netlink groups of the uevents sent by the kernel and by udev after it created the device links
+#define UEVENT_KERNEL_GROUP 1
+#define UEVENT_UDEV_GROUP 2
+
+// header of the uevents sent by udev, the properties follow at properties_off
+typedef struct udev_header {
+  char prefix[8];
+  unsigned int magic;
+  unsigned int header_size;
+  unsigned int properties_off;
+  unsigned int properties_len;
+} udev_header_t;
+
+static int is_event_device(const struct dirent *dir) {
+  return strncmp(EVENT_DEV_NAME, dir->d_name, 5) == 0;
+}
+
+static bool check_device(const char *filename) {
+  int fd = -1;
+  char name[256] = "???";
+  unsigned long bit[NBITS(KEY_MAX)];
+
+  fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  memset(bit, 0, sizeof(bit));
+  ioctl(fd, EVIOCGBIT(EV_KEY, KEY_MAX), bit);
+
+  ioctl(fd, EVIOCGNAME(sizeof(name)), name);
+  close(fd);
+
+  // the passthrough devices of grabbed touch devices look like touch devices too
+  size_t length = strlen(name);
+  if (length >= strlen(PASSTHROUGH_SUFFIX) && strcmp(&name[length - strlen(PASSTHROUGH_SUFFIX)], PASSTHROUGH_SUFFIX) == 0) {
+    return false;
+  }
+  if (test_bit(BTN_TOOL_QUINTTAP, bit)) {
+    printf("Found multi-touch input device: %s\n", name);
+    return true;
+  }
+
+  return false;
+}
+
+/*
+ * Opens every multi-touch input device found in DEV_INPUT_EVENT.
+ * @return number of opened devices
+ */
+static unsigned int scan_devices(int *fds) {
+  struct dirent **namelist;
+  unsigned int count = 0;
+
+  int ndev = scandir(DEV_INPUT_EVENT, &namelist, is_event_device, alphasort);
+  if (ndev <= 0) {
+    return 0;
+  }
+
+  for (int i = 0; i < ndev; i++) {
+    char filename[300];
+    snprintf(filename, sizeof(filename), "%s/%s", DEV_INPUT_EVENT, namelist[i]->d_name);
+    if (count < MAX_TOUCH_DEVICES && check_device(filename)) {
+      int fd = open(filename, O_RDONLY);
+      if (fd >= 0) {
+        fds[count] = fd;
+        count++;
+      }
+    }
+    free(namelist[i]);
+  }
+  free(namelist);
+
+  return count;
+}
+
+/*
+ * Calls callback for every path of the comma separated list given by TouchDevice
+ * until it returns false.
+ */
+static void for_each_configured_device(const configuration_t *config, bool (*callback)(const char*, void*),
+                                       void *data) {
+  unsigned int count = 0;
+  char *paths = strdup(config->touch_device_path);
+  if (!paths) {
+    die("error: strdup");
+  }
+
+  char *path = strtok(paths, ",");
+  while (path && count < MAX_TOUCH_DEVICES) {
+    while (*path == ' ') {
+      path++;
+    }
+    count++;
+    if (!callback(path, data)) {
+      break;
+    }
+    path = strtok(NULL, ",");
+  }
+
+  free(paths);
+}
+
+typedef struct opened_devices {
+  int *fds;
+  unsigned int count;
+} opened_devices_t;
+
+static bool open_configured_device(const char *path, void *data) {
+  opened_devices_t *devices = data;
+  int fd = open(path, O_RDONLY);
+  if (fd >= 0) {
+    devices->fds[devices->count] = fd;
+    devices->count++;
+  }
+  return true;
+}
+
+unsigned int open_touch_devices(const configuration_t *config, int *fds) {
+  if (config->touch_device_path) {
+    printf("Looking for input devices: %s\n", config->touch_device_path);
+    opened_devices_t devices = {
+      .fds = fds,
+      .count = 0
+    };
+    for_each_configured_device(config, &open_configured_device, &devices);
+    return devices.count;
+  } else {
+    printf("Looking for multi-touch input devices\n");
+    return scan_devices(fds);
+  }
+}
+
+typedef struct device_match {
+  dev_t rdev;
+  bool matches;
+} device_match_t;
+
+static bool match_configured_device(const char *path, void *data) {
+  device_match_t *match = data;
+  struct stat st;
+  // the configured path may be a link to the device node
+  if (stat(path, &st) == 0 && S_ISCHR(st.st_mode) && st.st_rdev == match->rdev) {
+    match->matches = true;
+    return false;
+  }
+  return true;
+}
+
+bool is_touch_device(const configuration_t *config, const char *path) {
+  if (config->touch_device_path) {
+    struct stat st;
+    if (stat(path, &st) < 0 || !S_ISCHR(st.st_mode)) {
+      return false;
+    }
+    device_match_t match = {
+      .rdev = st.st_rdev,
+      .matches = false
+    };
+    for_each_configured_device(config, &match_configured_device, &match);
+    return match.matches;
+  }
+  return check_device(path);
+}
+
+int create_uevent_socket(void) {
+  struct sockaddr_nl address;
+  int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+  if (fd < 0) {
+    return -1;
+  }
+  memset(&address, 0, sizeof(address));
+  address.nl_family = AF_NETLINK;
+  address.nl_groups = UEVENT_KERNEL_GROUP | UEVENT_UDEV_GROUP;
+  if (bind(fd, (struct sockaddr*) &address, sizeof(address)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int read_uevent(int fd, char *path, size_t size) {
+  char buffer[UEVENT_BUFFER_SIZE];
+  ssize_t length = recv(fd, buffer, sizeof(buffer) - 1, 0);
+  if (length < 0) {
+    return -1;
+  }
+  buffer[length] = '\0';
+
+  size_t offset;
+  if ((size_t) length >= sizeof(udev_header_t) && strcmp(buffer, "libudev") == 0) {
+    udev_header_t header;
+    memcpy(&header, buffer, sizeof(header));
+    offset = header.properties_off;
+  } else {
+    // the kernel starts with "ACTION@DEVPATH"
+    offset = strlen(buffer) + 1;
+  }
+
+  const char *action = NULL, *subsystem = NULL, *devname = NULL;
+  while (offset < (size_t) length) {
+    const char *property = &buffer[offset];
+    if (strncmp(property, "ACTION=", 7) == 0) {
+      action = property + 7;
+    } else if (strncmp(property, "SUBSYSTEM=", 10) == 0) {
+      subsystem = property + 10;
+    } else if (strncmp(property, "DEVNAME=", 8) == 0) {
+      devname = property + 8;
+    }
+    offset += strlen(property) + 1;
+  }
+
+  if (!action || !subsystem || !devname || strcmp(action, "add") != 0 || strcmp(subsystem, "input") != 0) {
+    return 0;
+  }
+  // the kernel reports the name relative to /dev, udev the full path
+  const char *name = strrchr(devname, '/');
+  name = name ? name + 1 : devname;
+  if (strncmp(name, EVENT_DEV_NAME, strlen(EVENT_DEV_NAME)) != 0) {
+    return 0;
+  }
+  snprintf(path, size, "%s/%s", DEV_INPUT_EVENT, name);
+  return 1;
+}
@@ -0,0 +1,58 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2014 Robin Müller.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef HOTPLUG_H_
+#define HOTPLUG_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "configuraion.h"
+
+#define MAX_TOUCH_DEVICES 8
+
+/*
+ * Opens the devices given by TouchDevice, or every multi-touch input device
+ * if none is configured. Missing devices can be attached later on hotplug.
+ * @return number of opened devices
+ */
+unsigned int open_touch_devices(const configuration_t *config, int *fds);
+/*
+ * @return true if the input device at path is one of the touch devices to use
+ */
+bool is_touch_device(const configuration_t *config, const char *path);
+/*
+ * Creates a netlink socket that receives the uevents of the kernel and udev.
+ * @return -1 on failure
+ */
+int create_uevent_socket(void);
+/*
+ * Reads the next pending uevent. If it is about a new input event device its
+ * device node is stored in path.
+ * @return 1 if an input event device was added, 0 for other uevents and -1 if
+ *         no uevent is pending
+ */
+int read_uevent(int fd, char *path, size_t size);
+
+#endif // HOTPLUG_H_
@@ -36,4 +36,17 @@ typedef struct input_event_array {
 
 #define new_input_event_array(length) (input_event_array_t*) new_array(length, sizeof(input_event_array_t), sizeof(struct input_event))
 
+// timestamp of an input_event in microseconds
+#define event_time_us(event) ((int64_t) (event).time.tv_sec * 1000000 + (event).time.tv_usec)
+
+// high resolution wheel codes, missing in the headers of kernels before 5.0
+#ifndef REL_WHEEL_HI_RES
+#define REL_WHEEL_HI_RES 0x0b
+#endif
+#ifndef REL_HWHEEL_HI_RES
+#define REL_HWHEEL_HI_RES 0x0c
+#endif
+// a high resolution wheel reports a notch of a normal wheel as this many units
+#define HI_RES_UNITS_PER_NOTCH 120
+
 #endif // INPUT_EVENT_ARRAY_H_
@@ -28,40 +28,38 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
-#include <dirent.h>
+#include <getopt.h>
 
 #include <linux/input.h>
 
 #include "common.h"
 #include "gestures_device.h"
-#include "gesture_detection.h"
+#include "emitter.h"
+#include "event_loop.h"
+#include "hotplug.h"
+#include "realtime.h"
+#include "replay.h"
 
+// room for the output of many read() batches
+#define EMIT_QUEUE_CAPACITY 4096
 
-#define DEV_INPUT_EVENT "/dev/input"
-#define EVENT_DEV_NAME "event"
-
-#define BITS_PER_LONG (sizeof(long) * 8)
-#define NBITS(x) ((((x)-1)/BITS_PER_LONG)+1)
-#define OFF(x)  ((x)%BITS_PER_LONG)
-#define BIT(x)  (1UL<<OFF(x))
-#define LONG(x) ((x)/BITS_PER_LONG)
-#define test_bit(bit, array) ((array[LONG(bit)] >> OFF(bit)) & 1)
-
-int uinput_fd, touch_device_fd;
+static void execute_events(input_event_array_t *input_events, void *data) {
+  send_events(*(int*) data, input_events);
+}
 
-static void execute_events(input_event_array_t *input_events) {
-  send_events(uinput_fd, input_events);
+static void queue_to_emitter(input_event_array_t *input_events, void *data) {
+  queue_events((emitter_t*) data, input_events);
 }
 
 static int_array_t *get_keys_array(configuration_t config) {
   unsigned int i, j, k;
   unsigned int keys_count = 0;
-  int_array_t *keys = new_int_array(MAX_FINGERS * DIRECTIONS_COUNT * MAX_KEYS_PER_GESTURE + 1);
+  int_array_t *keys = new_int_array(MAX_FINGERS * BINDINGS_COUNT * MAX_KEYS_PER_GESTURE + 1);
   for (i = 0; i < MAX_FINGERS; i++) {
-    for (j = 0; j < DIRECTIONS_COUNT; j++) {
+    for (j = 0; j < BINDINGS_COUNT; j++) {
       for (k = 0; k < MAX_KEYS_PER_GESTURE; k++) {
-        if (config.swipe_keys[i][j].keys[k] != -1) {
-          keys->data[keys_count] = config.swipe_keys[i][j].keys[k];
+        if (config.bindings[i][j].keys[k] != -1) {
+          keys->data[keys_count] = config.bindings[i][j].keys[k];
           keys_count++;
         }
       }
@@ -75,102 +73,74 @@ static int_array_t *get_keys_array(configuration_t config) {
   return keys;
 }
 
-static int is_event_device(const struct dirent *dir) {
-  return strncmp(EVENT_DEV_NAME, dir->d_name, 5) == 0;
+static void print_usage(const char *name) {
+  fprintf(stderr, "usage: %s [options] /path/to/config.file\n"
+          "  -r, --record FILE  record the events of the touch devices to FILE\n"
+          "  -R, --replay FILE  feed a recorded trace through the gesture detection and print the result\n"
+          "  -f, --fast         replay as fast as possible instead of in real time\n", name);
 }
 
-static bool check_device(char *device_name) {
-  char filename[64];
-  int fd = -1;
-  char name[256] = "???";
-  unsigned long bit[NBITS(KEY_MAX)];
-
-  snprintf(filename, sizeof(filename), "%s/%s", DEV_INPUT_EVENT, device_name);
-  fd = open(filename, O_RDONLY);
-  if (fd < 0) {
-    return false;
-  }
-
-  memset(bit, 0, sizeof(bit));
-  ioctl(fd, EVIOCGBIT(EV_KEY, KEY_MAX), bit);
-
-  ioctl(fd, EVIOCGNAME(sizeof(name)), name);
-  close(fd);
-
-  if (test_bit(BTN_TOOL_QUINTTAP, bit)) {
-    printf("Found multi-touch input device: %s\n", name);
-    return true;
-  }
-
-  return false;
-}
-
-static char* scan_devices(void) {
-  struct dirent **namelist;
-
-  int devnum = -1;
-  int ndev = scandir(DEV_INPUT_EVENT, &namelist, is_event_device, alphasort);
-  if (ndev <= 0) {
-    return NULL;
-  }
-
-  for (int i = 0; i < ndev; i++) {
-    if (devnum == -1 && check_device(namelist[i]->d_name)) {
-      sscanf(namelist[i]->d_name, "event%i", &devnum);
+int main(int argc, char *argv[]) {
+  static struct option long_options[] = {
+    { "record", required_argument, NULL, 'r' },
+    { "replay", required_argument, NULL, 'R' },
+    { "fast", no_argument, NULL, 'f' },
+    { NULL, 0, NULL, 0 }
+  };
+  char *record_path = NULL, *replay_path = NULL;
+  bool real_time = true;
+  int option;
+  while ((option = getopt_long(argc, argv, "r:R:f", long_options, NULL)) != -1) {
+    switch (option) {
+      case 'r':
+        record_path = optarg;
+        break;
+      case 'R':
+        replay_path = optarg;
+        break;
+      case 'f':
+        real_time = false;
+        break;
+      default:
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
     }
-    free(namelist[i]);
   }
-
-  if (devnum == -1) {
-    return NULL;
+  if (optind >= argc) {
+    print_usage(argv[0]);
+    return EXIT_FAILURE;
   }
 
-  char *filename = (char*) malloc(64 * sizeof(char));
-  sprintf(filename, "%s/%s%i", DEV_INPUT_EVENT, EVENT_DEV_NAME, devnum);
-  return filename;
-}
-
-static int open_touch_device(configuration_t config, int retry) {
-  if (config.touch_device_path) {
-    printf("Looking for input device: %s (Attempt %i/%i)\n", config.touch_device_path, retry + 1, config.retries + 1);
-    return open(config.touch_device_path, O_RDONLY);
-  } else {
-    printf("Looking for multi-touch input device (Attempt %i/%i)\n", retry + 1, config.retries + 1);
-    char *filename = scan_devices();
-    if (filename) {
-      return open(filename, O_RDONLY);
-    } else {
-      return -1;
-    }
+  configuration_t config = read_config(argv[optind]);
+  if (replay_path) {
+    return replay_trace(replay_path, &config, real_time);
   }
-}
-
-int main(int argc, char *argv[]) {
-  int exit_code = 0;
-  if (argc > 1) {
-    configuration_t config = read_config(argv[1]);
-    int_array_t *keys = get_keys_array(config);
-    uinput_fd = init_uinput(keys);
-    free(keys);
 
-    int retry = 0;
-    while (retry < config.retries + 1) {
-      touch_device_fd = open_touch_device(config, retry);
-      if (touch_device_fd > 0) {
-        break;
-      }
-      sleep(config.retry_delay);
-      retry++;
-    }
-    if (touch_device_fd < 0) {
-      die("Failed to open input device");
+  int_array_t *keys = get_keys_array(config);
+  int uinput_fd = init_uinput(keys, config.scroll.hi_res);
+  free(keys);
+
+  int touch_device_fds[MAX_TOUCH_DEVICES];
+  unsigned int touch_device_count = open_touch_devices(&config, touch_device_fds);
+  // devices that are missing now are attached when they appear
+  printf("Opened %u input device(s)\n", touch_device_count);
+  fflush(stdout);
+  apply_realtime_options(&config);
+  // the thread is started after the scheduling options are applied, so it inherits them
+  emitter_t *emitter = NULL;
+  if (config.realtime.emitter_thread) {
+    emitter = start_emitter(uinput_fd, EMIT_QUEUE_CAPACITY);
+    if (!emitter) {
+      die("error: start_emitter");
     }
-    printf("Opened input device\n");
-    fflush(stdout);
-    exit_code = process_events(touch_device_fd, config, &execute_events);
+  }
+  int exit_code = emitter ?
+    run_event_loop(touch_device_fds, touch_device_count, &config, argv[optind], &queue_to_emitter, emitter, record_path) :
+    run_event_loop(touch_device_fds, touch_device_count, &config, argv[optind], &execute_events, &uinput_fd, record_path);
 
-    close(touch_device_fd);
-    destroy_uinput(uinput_fd);
+  if (emitter) {
+    stop_emitter(emitter);
   }
+  destroy_uinput(uinput_fd);
   return exit_code;
 }
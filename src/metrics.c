@@ -0,0 +1,193 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2014 Robin Müller.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "metrics.h"
+
+#define METRICS_BUFFER_SIZE 16384
+
+metrics_t metrics;
+
+static const char *gesture_names[GESTURES_COUNT] = { "none", "scroll", "zoom", "swipe" };
+static const char *wakeup_names[WAKEUPS_COUNT] = { "blocking", "polling" };
+static const char *tap_names[TAPS_COUNT] = { "tap", "double_tap", "hold" };
+
+static const int64_t latency_buckets[LATENCY_BUCKETS_COUNT - 1] = LATENCY_BUCKETS;
+
+#define load_metric(counter) atomic_load_explicit(&(counter), memory_order_relaxed)
+
+void observe_latency(histogram_t *histogram, int64_t latency) {
+  unsigned int i = 0;
+  while (i < LATENCY_BUCKETS_COUNT - 1 && latency > latency_buckets[i]) {
+    i++;
+  }
+  atomic_fetch_add_explicit(&histogram->buckets[i], 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&histogram->count, 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&histogram->sum, latency > 0 ? latency : 0, memory_order_relaxed);
+}
+
+static size_t format_counter(char *buffer, size_t size, const char *name, const char *help, unsigned long value) {
+  return snprintf(buffer, size, "# HELP %s %s\n# TYPE %s counter\n%s %lu\n", name, help, name, name, value);
+}
+
+static size_t format_gauge(char *buffer, size_t size, const char *name, const char *help, unsigned long value) {
+  return snprintf(buffer, size, "# HELP %s %s\n# TYPE %s gauge\n%s %lu\n", name, help, name, name, value);
+}
+
+/*
+ * @param help NULL for further series of a histogram that was already described
+ * @param labels labels of the series followed by a comma, or an empty string
+ */
+static size_t format_histogram(char *buffer, size_t size, const char *name, const char *help, const char *labels,
+                               histogram_t *histogram) {
+  unsigned long cumulative = 0;
+  unsigned int i;
+  size_t length = help ? snprintf(buffer, size, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name) : 0;
+  // the labels without the trailing comma for _sum and _count
+  char series[64] = "";
+  if (strlen(labels) > 0) {
+    snprintf(series, sizeof(series), "{%.*s}", (int) strlen(labels) - 1, labels);
+  }
+  for (i = 0; i < LATENCY_BUCKETS_COUNT && length < size; i++) {
+    cumulative += load_metric(histogram->buckets[i]);
+    if (i < LATENCY_BUCKETS_COUNT - 1) {
+      length += snprintf(&buffer[length], size - length, "%s_bucket{%sle=\"%g\"} %lu\n",
+                         name, labels, latency_buckets[i] / 1000000.0, cumulative);
+    } else {
+      length += snprintf(&buffer[length], size - length, "%s_bucket{%sle=\"+Inf\"} %lu\n", name, labels, cumulative);
+    }
+  }
+  if (length < size) {
+    length += snprintf(&buffer[length], size - length, "%s_sum%s %g\n%s_count%s %lu\n",
+                       name, series, load_metric(histogram->sum) / 1000000.0, name, series,
+                       load_metric(histogram->count));
+  }
+  return length;
+}
+
+static size_t format_metrics(char *buffer, size_t size) {
+  unsigned int i, j;
+  size_t length = 0;
+
+#define append(call) if (length < size) { length += call; }
+  append(format_counter(&buffer[length], size - length, "touch_gestures_reads_total",
+                        "Number of read() calls on the touch devices", load_metric(metrics.reads)));
+  append(format_counter(&buffer[length], size - length, "touch_gestures_read_bytes_total",
+                        "Bytes read from the touch devices", load_metric(metrics.read_bytes)));
+  append(format_counter(&buffer[length], size - length, "touch_gestures_frames_total",
+                        "SYN_REPORT frames read from the touch devices", load_metric(metrics.frames)));
+  append(snprintf(&buffer[length], size - length,
+                  "# HELP touch_gestures_gestures_total Recognized gestures\n# TYPE touch_gestures_gestures_total counter\n"));
+  for (i = SCROLL; i < GESTURES_COUNT; i++) {
+    for (j = 0; j < MAX_FINGERS; j++) {
+      append(snprintf(&buffer[length], size - length, "touch_gestures_gestures_total{gesture=\"%s\",fingers=\"%u\"} %lu\n",
+                      gesture_names[i], INDEX_TO_FINGER(j), load_metric(metrics.gestures[i][j])));
+    }
+  }
+  append(snprintf(&buffer[length], size - length,
+                  "# HELP touch_gestures_taps_total Sent tap gestures\n# TYPE touch_gestures_taps_total counter\n"));
+  for (i = 0; i < TAPS_COUNT; i++) {
+    for (j = 0; j < MAX_FINGERS; j++) {
+      append(snprintf(&buffer[length], size - length, "touch_gestures_taps_total{tap=\"%s\",fingers=\"%u\"} %lu\n",
+                      tap_names[i], INDEX_TO_FINGER(j), load_metric(metrics.taps[i][j])));
+    }
+  }
+  append(format_counter(&buffer[length], size - length, "touch_gestures_emitted_events_total",
+                        "Events written to uinput", load_metric(metrics.emitted_events)));
+  append(format_counter(&buffer[length], size - length, "touch_gestures_forwarded_events_total",
+                        "Events of grabbed touch devices passed on to their passthrough devices",
+                        load_metric(metrics.forwarded_events)));
+  append(format_counter(&buffer[length], size - length, "touch_gestures_writes_total",
+                        "write() calls on uinput", load_metric(metrics.writes)));
+  append(format_counter(&buffer[length], size - length, "touch_gestures_kinetic_scroll_ticks_total",
+                        "Ticks of the kinetic scroll timer", load_metric(metrics.kinetic_scroll_ticks)));
+  append(format_counter(&buffer[length], size - length, "touch_gestures_emit_queue_stalls_total",
+                        "Times the reader waited because the queue of the emitter thread was full",
+                        load_metric(metrics.emit_queue_stalls)));
+  append(format_gauge(&buffer[length], size - length, "touch_gestures_emit_queue_peak_events",
+                      "Most events waiting for the emitter thread at once", load_metric(metrics.emit_queue_peak)));
+  append(format_histogram(&buffer[length], size - length, "touch_gestures_latency_seconds",
+                          "Time from the kernel timestamp of an input event to the write of the resulting events",
+                          "", &metrics.latency));
+  for (i = 0; i < WAKEUPS_COUNT; i++) {
+    char labels[32];
+    snprintf(labels, sizeof(labels), "wakeup=\"%s\",", wakeup_names[i]);
+    append(format_histogram(&buffer[length], size - length, "touch_gestures_wakeup_latency_seconds",
+                            i == 0 ? "Time from the kernel timestamp of an input event until it is read, by how the "
+                            "event loop was woken up" : NULL, labels, &metrics.wakeup_latency[i]));
+  }
+  append(format_histogram(&buffer[length], size - length, "touch_gestures_swipe_time_saved_seconds",
+                          "Time a predicted swipe was sent before its fingers passed the threshold", "",
+                          &metrics.swipe_time_saved));
+  append(format_counter(&buffer[length], size - length, "touch_gestures_missed_swipe_predictions_total",
+                        "Predicted swipes whose fingers didn't pass the threshold in the predicted direction",
+                        load_metric(metrics.missed_swipe_predictions)));
+#undef append
+  return length < size ? length : size - 1;
+}
+
+int create_metrics_socket(const char *path) {
+  struct sockaddr_un address;
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    return -1;
+  }
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  unlink(path);
+  if (bind(fd, (struct sockaddr*) &address, sizeof(address)) < 0 || listen(fd, 4) < 0) {
+    close(fd);
+    return -1;
+  }
+  chmod(path, 0660);
+  return fd;
+}
+
+void serve_metrics(int socket_fd) {
+  static char buffer[METRICS_BUFFER_SIZE];
+  // a slow client must not block the event loop
+  int client_fd = accept4(socket_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+  if (client_fd < 0) {
+    return;
+  }
+  size_t length = format_metrics(buffer, sizeof(buffer));
+  // a client that disconnected early would raise SIGPIPE otherwise
+  if (send(client_fd, buffer, length, MSG_NOSIGNAL) < 0 && errno != EPIPE && errno != EAGAIN &&
+      errno != ECONNRESET) {
+    perror("error: send metrics");
+  }
+  close(client_fd);
+}
@@ -0,0 +1,100 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2014 Robin Müller.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef METRICS_H_
+#define METRICS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#include "configuraion.h"
+#include "gesture_detection.h"
+
+// upper bounds of the latency buckets in microseconds, the last bucket is +Inf
+#define LATENCY_BUCKETS_COUNT 12
+#define LATENCY_BUCKETS { 50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000 }
+
+typedef struct histogram {
+  atomic_ulong buckets[LATENCY_BUCKETS_COUNT];
+  atomic_ulong count;
+  // microseconds
+  atomic_ullong sum;
+} histogram_t;
+
+/*
+ * Process wide counters. They are only updated with relaxed atomic additions,
+ * so every thread can update them without locking.
+ */
+// how the event loop found the input events it read
+typedef enum wakeup {
+  // epoll_wait() returned after sleeping
+  BLOCKING_WAKEUP,
+  // epoll_wait() found them while busy polling
+  POLLING_WAKEUP,
+  WAKEUPS_COUNT
+} wakeup_t;
+
+typedef struct metrics {
+  atomic_ulong reads;
+  atomic_ulong read_bytes;
+  atomic_ulong frames;
+  atomic_ulong gestures[GESTURES_COUNT][MAX_FINGERS];
+  atomic_ulong taps[TAPS_COUNT][MAX_FINGERS];
+  atomic_ulong emitted_events;
+  // events of grabbed touch devices passed on to their passthrough devices
+  atomic_ulong forwarded_events;
+  atomic_ulong writes;
+  atomic_ulong kinetic_scroll_ticks;
+  // the reader had to wait for the emitter thread
+  atomic_ulong emit_queue_stalls;
+  // the most events that were waiting for the emitter thread at once
+  atomic_ulong emit_queue_peak;
+  // predicted swipes whose fingers didn't pass the threshold in the predicted direction
+  atomic_ulong missed_swipe_predictions;
+  // from input_event.time to the write to uinput
+  histogram_t latency;
+  // from input_event.time to the return of read()
+  histogram_t wakeup_latency[WAKEUPS_COUNT];
+  // from the prediction of a swipe until its fingers passed the threshold
+  histogram_t swipe_time_saved;
+} metrics_t;
+
+extern metrics_t metrics;
+
+#define count_metric(counter, value) atomic_fetch_add_explicit(&metrics.counter, value, memory_order_relaxed)
+
+void observe_latency(histogram_t *histogram, int64_t latency);
+/*
+ * Creates a listening unix socket at path, an existing socket file is replaced.
+ * @return the socket's fd or -1 on error
+ */
+int create_metrics_socket(const char *path);
+/*
+ * Accepts one connection on the metrics socket, writes all metrics in the
+ * Prometheus text format to it and closes it again.
+ */
+void serve_metrics(int socket_fd);
+
+#endif // METRICS_H_
@@ -0,0 +1,153 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2014 Robin Müller.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#include "realtime.h"
+
+/*
+ * Parses a list of CPUs like "0,2-3".
+ * @return false if the list is invalid
+ */
+static bool parse_cpus(const char *cpus, cpu_set_t *set) {
+  const char *ptr = cpus;
+  CPU_ZERO(set);
+  while (*ptr) {
+    char *end;
+    long first = strtol(ptr, &end, 10);
+    long last = first;
+    if (end == ptr || first < 0) {
+      return false;
+    }
+    if (*end == '-') {
+      ptr = end + 1;
+      last = strtol(ptr, &end, 10);
+      if (end == ptr || last < first) {
+        return false;
+      }
+    }
+    if (last >= CPU_SETSIZE) {
+      return false;
+    }
+    for (; first <= last; first++) {
+      CPU_SET(first, set);
+    }
+    while (*end == ',' || *end == ' ') {
+      end++;
+    }
+    ptr = end;
+  }
+  return CPU_COUNT(set) > 0;
+}
+
+static const char *get_policy_name(int policy) {
+  switch (policy) {
+    case SCHED_FIFO:
+      return "SCHED_FIFO";
+    case SCHED_RR:
+      return "SCHED_RR";
+    case SCHED_OTHER:
+      return "SCHED_OTHER";
+    default:
+      return "unknown";
+  }
+}
+
+/*
+ * Prints the CPUs of the set in the same format as they are configured.
+ */
+static void print_cpus(const cpu_set_t *set) {
+  int cpu = 0;
+  const char *separator = "";
+  while (cpu < CPU_SETSIZE) {
+    if (!CPU_ISSET(cpu, set)) {
+      cpu++;
+      continue;
+    }
+    int last = cpu;
+    while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, set)) {
+      last++;
+    }
+    if (last > cpu) {
+      printf("%s%d-%d", separator, cpu, last);
+    } else {
+      printf("%s%d", separator, cpu);
+    }
+    separator = ",";
+    cpu = last + 1;
+  }
+}
+
+/*
+ * Prints the settings the process actually runs with.
+ */
+static void report_realtime_options(bool memory_locked) {
+  struct sched_param param;
+  cpu_set_t set;
+  int policy = sched_getscheduler(0);
+  if (policy >= 0 && sched_getparam(0, &param) == 0) {
+    printf("Scheduler: %s, priority %d\n", get_policy_name(policy), param.sched_priority);
+  }
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    printf("CPUs: ");
+    print_cpus(&set);
+    printf("\n");
+  }
+  printf("Memory locked: %s\n", memory_locked ? "yes" : "no");
+  fflush(stdout);
+}
+
+void apply_realtime_options(const configuration_t *config) {
+  bool memory_locked = false;
+  if (config->realtime.cpus) {
+    cpu_set_t set;
+    if (!parse_cpus(config->realtime.cpus, &set)) {
+      fprintf(stderr, "warning: invalid list of CPUs '%s'\n", config->realtime.cpus);
+    } else if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+      fprintf(stderr, "warning: can't run on CPUs %s: %s\n", config->realtime.cpus, strerror(errno));
+    }
+  }
+  if (config->realtime.policy != SCHED_OTHER) {
+    struct sched_param param = {
+      .sched_priority = config->realtime.priority
+    };
+    if (sched_setscheduler(0, config->realtime.policy, &param) < 0) {
+      fprintf(stderr, "warning: can't use %s with priority %d: %s\n", get_policy_name(config->realtime.policy),
+              config->realtime.priority, strerror(errno));
+    }
+  }
+  if (config->realtime.lock_memory) {
+    // the memory allocated later, e.g. for reloaded configurations, is locked as well
+    memory_locked = mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+    if (!memory_locked) {
+      fprintf(stderr, "warning: can't lock the memory: %s\n", strerror(errno));
+    }
+  }
+  report_realtime_options(memory_locked);
+}
@@ -0,0 +1,187 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2014 Robin Müller.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <poll.h>
+
+#include <linux/input.h>
+
+#include "common.h"
+#include "gesture_detection.h"
+#include "metrics.h"
+#include "replay.h"
+#include "trace.h"
+
+#define MAX_EVENTS_PER_FRAME 64
+#define EMIT_BUFFER_CAPACITY 256
+// how long to wait for a kinetic scroll or a tap to end after the trace is finished
+#define TIMERS_TIMEOUT 300
+
+static int64_t monotonic_time_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (int64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+#define monotonic_time_us() (monotonic_time_ns() / 1000)
+
+static void print_events(input_event_array_t *input_events, void *data) {
+  size_t i;
+  for (i = 0; i < input_events->length; i++) {
+    struct input_event *event = &input_events->data[i];
+    switch (event->type) {
+      case EV_SYN:
+        printf("EV_SYN %u %d\n", event->code, event->value);
+        break;
+      case EV_KEY:
+        printf("EV_KEY %u %d\n", event->code, event->value);
+        break;
+      case EV_REL:
+        printf("EV_REL %u %d\n", event->code, event->value);
+        break;
+      default:
+        printf("%u %u %d\n", event->type, event->code, event->value);
+    }
+  }
+  *(unsigned long*) data += input_events->length;
+}
+
+/*
+ * Processes the kinetic scroll and tap timers until due (or until both were idle
+ * for timeout milliseconds if due is negative).
+ */
+static void wait_until(gesture_state_t *state, emit_buffer_t *emit_buffer, int64_t due, int timeout) {
+  struct pollfd timers[2] = {
+    { .fd = get_scroll_timer_fd(state), .events = POLLIN },
+    { .fd = get_tap_timer_fd(state), .events = POLLIN }
+  };
+  while (due < 0 || monotonic_time_us() < due) {
+    if (due >= 0) {
+      timeout = (int) ((due - monotonic_time_us() + 999) / 1000);
+    }
+    if (poll(timers, 2, timeout > 0 ? timeout : 0) <= 0) {
+      if (due < 0) {
+        return;
+      }
+      continue;
+    }
+    if (timers[0].revents & POLLIN) {
+      process_scroll_timer(state, emit_buffer);
+    }
+    if (timers[1].revents & POLLIN) {
+      process_tap_timer(state, emit_buffer);
+    }
+    flush_emit_buffer(emit_buffer);
+  }
+}
+
+int replay_trace(const char *filename, configuration_t *config, bool real_time) {
+  struct input_event frame[MAX_EVENTS_PER_FRAME];
+  unsigned long events_count = 0, frames_count = 0, emitted_events = 0;
+  int64_t first_event_time = -1;
+  // event time of the last kinetic scroll tick in a fast replay
+  int64_t scroll_tick_time = 0;
+  // time spent in the recognizer only (in nanoseconds), printing the events is not included
+  int64_t processing_time = 0;
+
+  trace_reader_t *reader = open_trace_reader(filename);
+  if (!reader) {
+    fprintf(stderr, "error: %s is no readable trace\n", filename);
+    return EXIT_FAILURE;
+  }
+  gesture_state_t *state = new_gesture_state(&reader->info, config);
+  emit_buffer_t *emit_buffer = new_emit_buffer(EMIT_BUFFER_CAPACITY, &print_events, &emitted_events);
+  if (!state || !emit_buffer) {
+    die("error: replay_trace");
+  }
+
+  int64_t start = monotonic_time_us();
+  size_t length = 0;
+  bool more = true;
+  while (more) {
+    more = read_trace_event(reader, &frame[length]);
+    if (more) {
+      length++;
+      events_count++;
+    }
+    // a frame is complete with its SYN_REPORT
+    bool complete = length > 0 &&
+      ((frame[length - 1].type == EV_SYN && frame[length - 1].code == SYN_REPORT) || length == MAX_EVENTS_PER_FRAME);
+    if (complete || (!more && length > 0)) {
+      if (real_time) {
+        if (first_event_time < 0) {
+          first_event_time = event_time_us(frame[0]);
+        }
+        wait_until(state, emit_buffer, start + event_time_us(frame[0]) - first_event_time, 0);
+      } else if (is_kinetic_scrolling(state)) {
+        // the ticks the timer would have run until this frame
+        int64_t ticks = (event_time_us(frame[0]) - scroll_tick_time) / (SCROLL_TICK * 1000);
+        if (ticks > 0) {
+          process_scroll_ticks(state, emit_buffer, ticks);
+          scroll_tick_time += ticks * SCROLL_TICK * 1000;
+        }
+      }
+      bool scrolling = is_kinetic_scrolling(state);
+      int64_t processing_start = monotonic_time_ns();
+      process_events(state, frame, length, emit_buffer);
+      processing_time += monotonic_time_ns() - processing_start;
+      if (!scrolling && is_kinetic_scrolling(state)) {
+        scroll_tick_time = event_time_us(frame[length - 1]);
+      }
+      flush_emit_buffer(emit_buffer);
+      frames_count++;
+      length = 0;
+    }
+  }
+  int64_t elapsed = monotonic_time_us() - start;
+  if (real_time) {
+    wait_until(state, emit_buffer, -1, TIMERS_TIMEOUT);
+  } else {
+    // a kinetic scroll and a released tap would wait for their timers otherwise
+    if (is_kinetic_scrolling(state)) {
+      process_scroll_ticks(state, emit_buffer, UINT64_MAX);
+    }
+    park_gesture_state(state, emit_buffer);
+    flush_emit_buffer(emit_buffer);
+  }
+  fflush(stdout);
+
+  fprintf(stderr, "replayed %lu events in %lu frames in %.3f ms, recognizer %.1f ns/event, emitted %lu events\n",
+          events_count, frames_count, elapsed / 1000.0,
+          events_count > 0 ? (double) processing_time / events_count : 0.0, emitted_events);
+  unsigned long predictions = metrics.swipe_time_saved.count;
+  if (predictions > 0 || metrics.missed_swipe_predictions > 0) {
+    fprintf(stderr, "predicted %lu swipes %.1f ms early on average, %lu predictions missed\n",
+            predictions, predictions > 0 ? metrics.swipe_time_saved.sum / 1000.0 / predictions : 0.0,
+            (unsigned long) metrics.missed_swipe_predictions);
+  }
+
+  free_emit_buffer(emit_buffer);
+  free_gesture_state(state);
+  close_trace_reader(reader);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,219 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2014 Robin Müller.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+
+// enough for the largest possible encoding of one event
+#define MAX_EVENT_SIZE 30
+#define MAX_EVENTS_PER_WRITE 64
+#define WRITE_BUFFER_SIZE 65536
+
+#define zigzag_encode(value) (((uint64_t) (value) << 1) ^ (uint64_t) ((int64_t) (value) >> 63))
+#define zigzag_decode(value) ((int64_t) ((value) >> 1) ^ -(int64_t) ((value) & 1))
+
+struct trace_writer {
+  FILE *file;
+  int64_t last_time;
+};
+
+// the axes stored in the header of a trace
+static const unsigned int trace_axes[] = { ABS_X, ABS_Y, ABS_MT_SLOT };
+
+static struct input_absinfo *get_axis_info(device_info_t *info, unsigned int code) {
+  switch (code) {
+    case ABS_X:
+      return &info->x;
+    case ABS_Y:
+      return &info->y;
+    case ABS_MT_SLOT:
+      return &info->slot;
+    default:
+      return NULL;
+  }
+}
+
+static size_t encode_varint(uint8_t *buffer, uint64_t value) {
+  size_t length = 0;
+  while (value >= 0x80) {
+    buffer[length] = (uint8_t) (value | 0x80);
+    value >>= 7;
+    length++;
+  }
+  buffer[length] = (uint8_t) value;
+  return length + 1;
+}
+
+static bool decode_varint(trace_reader_t *reader, uint64_t *value) {
+  unsigned int shift = 0;
+  *value = 0;
+  while (reader->offset < reader->size && shift < 64) {
+    uint8_t byte = reader->data[reader->offset];
+    reader->offset++;
+    *value |= (uint64_t) (byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return true;
+    }
+    shift += 7;
+  }
+  return false;
+}
+
+trace_writer_t *open_trace_writer(const char *filename, const device_info_t *info) {
+  uint8_t header[sizeof(TRACE_MAGIC) + 1 + MAX_EVENT_SIZE * 8];
+  size_t i, length = 0;
+  device_info_t header_info = *info;
+
+  trace_writer_t *writer = malloc(sizeof(trace_writer_t));
+  if (!writer) {
+    return NULL;
+  }
+  writer->file = fopen(filename, "wb");
+  if (!writer->file) {
+    free(writer);
+    return NULL;
+  }
+  setvbuf(writer->file, NULL, _IOFBF, WRITE_BUFFER_SIZE);
+  writer->last_time = 0;
+
+  memcpy(header, TRACE_MAGIC, strlen(TRACE_MAGIC));
+  length += strlen(TRACE_MAGIC);
+  header[length] = TRACE_VERSION;
+  length++;
+  length += encode_varint(&header[length], sizeof(trace_axes) / sizeof(trace_axes[0]));
+  for (i = 0; i < sizeof(trace_axes) / sizeof(trace_axes[0]); i++) {
+    struct input_absinfo *absinfo = get_axis_info(&header_info, trace_axes[i]);
+    length += encode_varint(&header[length], trace_axes[i]);
+    length += encode_varint(&header[length], zigzag_encode(absinfo->minimum));
+    length += encode_varint(&header[length], zigzag_encode(absinfo->maximum));
+    length += encode_varint(&header[length], zigzag_encode(absinfo->resolution));
+  }
+  fwrite(header, 1, length, writer->file);
+  return writer;
+}
+
+void write_trace_events(trace_writer_t *writer, struct input_event *events, size_t count) {
+  uint8_t buffer[MAX_EVENT_SIZE * MAX_EVENTS_PER_WRITE];
+  size_t i, length = 0;
+  for (i = 0; i < count; i++) {
+    int64_t time = event_time_us(events[i]);
+    length += encode_varint(&buffer[length], zigzag_encode(time - writer->last_time));
+    length += encode_varint(&buffer[length], ((uint64_t) events[i].code << 5) | events[i].type);
+    length += encode_varint(&buffer[length], zigzag_encode(events[i].value));
+    writer->last_time = time;
+    if (length > sizeof(buffer) - MAX_EVENT_SIZE) {
+      fwrite(buffer, 1, length, writer->file);
+      length = 0;
+    }
+  }
+  fwrite(buffer, 1, length, writer->file);
+}
+
+void close_trace_writer(trace_writer_t *writer) {
+  fclose(writer->file);
+  free(writer);
+}
+
+trace_reader_t *open_trace_reader(const char *filename) {
+  struct stat file_stat;
+  uint64_t axes_count, code, minimum, maximum, resolution;
+
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  if (fstat(fd, &file_stat) < 0 || file_stat.st_size < (off_t) strlen(TRACE_MAGIC) + 1) {
+    close(fd);
+    return NULL;
+  }
+  void *data = mmap(NULL, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    return NULL;
+  }
+  madvise(data, file_stat.st_size, MADV_SEQUENTIAL);
+
+  trace_reader_t *reader = calloc(1, sizeof(trace_reader_t));
+  if (!reader) {
+    munmap(data, file_stat.st_size);
+    return NULL;
+  }
+  reader->data = data;
+  reader->size = file_stat.st_size;
+
+  if (memcmp(reader->data, TRACE_MAGIC, strlen(TRACE_MAGIC)) != 0 ||
+      reader->data[strlen(TRACE_MAGIC)] != TRACE_VERSION) {
+    close_trace_reader(reader);
+    return NULL;
+  }
+  reader->offset = strlen(TRACE_MAGIC) + 1;
+
+  if (!decode_varint(reader, &axes_count)) {
+    close_trace_reader(reader);
+    return NULL;
+  }
+  while (axes_count > 0) {
+    if (!decode_varint(reader, &code) || !decode_varint(reader, &minimum) ||
+        !decode_varint(reader, &maximum) || !decode_varint(reader, &resolution)) {
+      close_trace_reader(reader);
+      return NULL;
+    }
+    // axes unknown to this version are skipped
+    struct input_absinfo *absinfo = get_axis_info(&reader->info, code);
+    if (absinfo) {
+      absinfo->minimum = zigzag_decode(minimum);
+      absinfo->maximum = zigzag_decode(maximum);
+      absinfo->resolution = zigzag_decode(resolution);
+    }
+    axes_count--;
+  }
+  return reader;
+}
+
+bool read_trace_event(trace_reader_t *reader, struct input_event *event) {
+  uint64_t time_delta, type_code, value;
+  if (!decode_varint(reader, &time_delta) || !decode_varint(reader, &type_code) || !decode_varint(reader, &value)) {
+    return false;
+  }
+  int64_t time = reader->last_time + zigzag_decode(time_delta);
+  reader->last_time = time;
+  event->time.tv_sec = time / 1000000;
+  event->time.tv_usec = time % 1000000;
+  event->type = type_code & 0x1f;
+  event->code = type_code >> 5;
+  event->value = (int32_t) zigzag_decode(value);
+  return true;
+}
+
+void close_trace_reader(trace_reader_t *reader) {
+  munmap((void*) reader->data, reader->size);
+  free(reader);
+}
@@ -0,0 +1,70 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2014 Robin Müller.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <linux/input.h>
+
+#include "gesture_detection.h"
+
+/*
+ * A trace starts with TRACE_MAGIC, the format version and the axes of the
+ * recorded device. It is followed by the events, each one encoded as varints:
+ * the zigzag encoded time since the previous event in microseconds, the code
+ * and type packed as (code << 5 | type) and the zigzag encoded value.
+ */
+#define TRACE_MAGIC "LTGT"
+#define TRACE_VERSION 1
+
+typedef struct trace_writer trace_writer_t;
+
+typedef struct trace_reader {
+  const uint8_t *data;
+  size_t size;
+  size_t offset;
+  int64_t last_time;
+  device_info_t info;
+} trace_reader_t;
+
+trace_writer_t *open_trace_writer(const char *filename, const device_info_t *info);
+void write_trace_events(trace_writer_t *writer, struct input_event *events, size_t count);
+void close_trace_writer(trace_writer_t *writer);
+
+/*
+ * Maps the trace into memory and reads its header.
+ * @return NULL if the file can't be mapped or isn't a trace
+ */
+trace_reader_t *open_trace_reader(const char *filename);
+/*
+ * @return false at the end of the trace
+ */
+bool read_trace_event(trace_reader_t *reader, struct input_event *event);
+void close_trace_reader(trace_reader_t *reader);
+
+#endif // TRACE_H_
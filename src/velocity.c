@@ -0,0 +1,73 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2014 Robin Müller.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "velocity.h"
+
+void reset_velocity_tracker(velocity_tracker_t *tracker) {
+  tracker->head = 0;
+  tracker->count = 0;
+}
+
+void add_velocity_sample(velocity_tracker_t *tracker, int64_t time, int x, int y) {
+  velocity_sample_t *sample = &tracker->samples[tracker->head];
+  sample->time = time;
+  sample->x = x;
+  sample->y = y;
+  tracker->head = (tracker->head + 1) % VELOCITY_SAMPLES;
+  if (tracker->count < VELOCITY_SAMPLES) {
+    tracker->count++;
+  }
+}
+
+bool estimate_velocity(velocity_tracker_t *tracker, int64_t now, double *x_velocity, double *y_velocity) {
+  unsigned int i, n = 0;
+  double sum_t = 0, sum_x = 0, sum_y = 0, sum_tt = 0, sum_tx = 0, sum_ty = 0;
+  for (i = 0; i < tracker->count; i++) {
+    // walk from the newest to the oldest sample
+    velocity_sample_t *sample = &tracker->samples[(tracker->head + VELOCITY_SAMPLES - 1 - i) % VELOCITY_SAMPLES];
+    if (now - sample->time > VELOCITY_WINDOW) {
+      break;
+    }
+    // relative times in milliseconds keep the sums small
+    double t = (sample->time - now) / 1000.0;
+    sum_t += t;
+    sum_x += sample->x;
+    sum_y += sample->y;
+    sum_tt += t * t;
+    sum_tx += t * sample->x;
+    sum_ty += t * sample->y;
+    n++;
+  }
+  if (n < 2) {
+    return false;
+  }
+  double denominator = n * sum_tt - sum_t * sum_t;
+  if (denominator == 0) {
+    // all samples have the same timestamp
+    return false;
+  }
+  *x_velocity = (n * sum_tx - sum_t * sum_x) / denominator;
+  *y_velocity = (n * sum_ty - sum_t * sum_y) / denominator;
+  return true;
+}
@@ -0,0 +1,60 @@
+/*
+ * The MIT License
+ *
+ * Copyright 2014 Robin Müller.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef VELOCITY_H_
+#define VELOCITY_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define VELOCITY_SAMPLES 8
+// samples older than this (in microseconds) are ignored by the estimation
+#define VELOCITY_WINDOW 100000
+
+typedef struct velocity_sample {
+  int64_t time;
+  int x;
+  int y;
+} velocity_sample_t;
+
+/*
+ * Ring buffer of the latest positions of one finger.
+ */
+typedef struct velocity_tracker {
+  unsigned int head;
+  unsigned int count;
+  velocity_sample_t samples[VELOCITY_SAMPLES];
+} velocity_tracker_t;
+
+void reset_velocity_tracker(velocity_tracker_t *tracker);
+void add_velocity_sample(velocity_tracker_t *tracker, int64_t time, int x, int y);
+/*
+ * Fits a line through the samples of the last VELOCITY_WINDOW microseconds
+ * before now (least squares).
+ * @return false if there are not enough samples, otherwise x_velocity and
+ *         y_velocity are set to the distance per millisecond
+ */
+bool estimate_velocity(velocity_tracker_t *tracker, int64_t now, double *x_velocity, double *y_velocity);
+
+#endif // VELOCITY_H_